@@ -26,9 +26,20 @@
 #include "src/common.h"
 #include "src/log.h"
 #include "src/info.h"
+#include "src/memory.h"
+#include "src/threadpool.h"
+#include "src/executor.h"
+#include "src/budget.h"
 #include "src/model.h"
+#include "src/adapter.h"
 #include "src/context.h"
 #include "src/embedding.h"
+#include "src/cache.h"
+#include "src/similarity.h"
+#include "src/bm25.h"
+#include "src/kmeans.h"
+#include "src/lsh.h"
+#include "src/ivfpq.h"
 
 Napi::Object registerCallback(Napi::Env env, Napi::Object exports)
 {
@@ -45,11 +56,33 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports)
       Napi::PropertyDescriptor::Function("getGpuVramInfo", getGpuVramInfo),
       Napi::PropertyDescriptor::Function("getGpuDeviceInfo", getGpuDeviceInfo),
       Napi::PropertyDescriptor::Function("getGpuType", getGpuType),
+      Napi::PropertyDescriptor::Function("getMemoryUsage", getMemoryUsage),
+      Napi::PropertyDescriptor::Function("setLogLevel", setLogLevel),
+      Napi::PropertyDescriptor::Function("getLogLevel", getLogLevel),
+      Napi::PropertyDescriptor::Function("drainLogs", drainLogs),
+      Napi::PropertyDescriptor::Function("getLogStats", getLogStats),
+      Napi::PropertyDescriptor::Function("subscribeLogs", subscribeLogs),
+      Napi::PropertyDescriptor::Function("unsubscribeLogs", unsubscribeLogs),
+      Napi::PropertyDescriptor::Function("numaInit", numaInit),
+      Napi::PropertyDescriptor::Function("getNumaNodes", getNumaNodes),
+      Napi::PropertyDescriptor::Function("getExecutorStats", getExecutorStats),
+      Napi::PropertyDescriptor::Function("resetExecutorStats", resetExecutorStats),
+      Napi::PropertyDescriptor::Function("setExecutorThreads", setExecutorThreads),
+      Napi::PropertyDescriptor::Function("setBudget", setBudget),
+      Napi::PropertyDescriptor::Function("getBudgetStats", getBudgetStats),
+      Napi::PropertyDescriptor::Function("maxSim", maxSim),
+      Napi::PropertyDescriptor::Function("kmeans", kmeans),
+      Napi::PropertyDescriptor::Function("nearDuplicates", nearDuplicates),
   });
+  LlamaThreadPool::init(exports);
   LlamaModel::init(exports);
+  LlamaAdapter::init(exports);
   LlamaContext::init(exports);
   LlamaContextSampler::init(exports);
   LlamaEmbeddingContext::init(exports);
+  LlamaEmbeddingCache::init(exports);
+  LlamaBM25Index::init(exports);
+  LlamaIVFPQIndex::init(exports);
   return exports;
 }
 
@@ -0,0 +1,173 @@
+//
+//  adapter.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <map>
+
+#include "common.h"
+#include "model.h"
+#include "worker.h"
+
+class LlamaAdapter : public Napi::ObjectWrap<LlamaAdapter>
+{
+public:
+  LlamaModel *model;
+  llama_adapter_lora *adapter = NULL;
+  std::string path;
+  uint32_t attached = 0;
+
+  LlamaAdapter(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaAdapter>(info)
+  {
+    model = Napi::ObjectWrap<LlamaModel>::Unwrap(info[0].As<Napi::Object>());
+    model->Ref();
+    path = info[1].As<Napi::String>().Utf8Value();
+  }
+
+  ~LlamaAdapter()
+  {
+    dispose();
+  }
+
+  void dispose()
+  {
+    if (model == NULL)
+    {
+      return;
+    }
+    if (adapter != NULL)
+    {
+      llama_adapter_lora_free(adapter);
+      adapter = NULL;
+    }
+    model->Unref();
+    model = NULL;
+  }
+
+  Napi::Value Load(const Napi::CallbackInfo &info)
+  {
+    this->Ref();
+
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          adapter = llama_adapter_lora_init(model->model, path.c_str());
+          if (adapter == NULL)
+          {
+            throw std::runtime_error("Failed to load adapter " + path);
+          }
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue();
+    return worker->Promise();
+  }
+
+  Napi::Value Dispose(const Napi::CallbackInfo &info)
+  {
+    if (attached > 0)
+    {
+      Napi::Error::New(Env(), "Adapter is attached to a context").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    dispose();
+    return Env().Undefined();
+  }
+
+  static void init(Napi::Object exports)
+  {
+    auto def = DefineClass(
+        exports.Env(),
+        "LlamaAdapter",
+        {
+            InstanceMethod("load", &LlamaAdapter::Load),
+            InstanceMethod("dispose", &LlamaAdapter::Dispose),
+        });
+    exports.Set("LlamaAdapter", def);
+  }
+};
+
+// The adapters applied to a context. The set is owned by the JS thread and every change
+// is applied as a whole on the context queue, so it never races an evaluation.
+struct llama_node_adapters
+{
+  std::map<LlamaAdapter *, float> scales;
+
+  void set(LlamaAdapter *adapter, float scale)
+  {
+    if (scales.count(adapter) == 0)
+    {
+      adapter->Ref();
+      adapter->attached++;
+    }
+    scales[adapter] = scale;
+  }
+
+  std::vector<LlamaAdapter *> remove(LlamaAdapter *adapter)
+  {
+    std::vector<LlamaAdapter *> removed;
+    if (scales.erase(adapter) != 0)
+    {
+      removed.push_back(adapter);
+    }
+    return removed;
+  }
+
+  std::vector<LlamaAdapter *> clear()
+  {
+    std::vector<LlamaAdapter *> removed;
+    for (const auto &item : scales)
+    {
+      removed.push_back(item.first);
+    }
+    scales.clear();
+    return removed;
+  }
+
+  static void apply(llama_context *ctx, const std::map<LlamaAdapter *, float> &scales)
+  {
+    llama_clear_adapter_lora(ctx);
+    for (const auto &item : scales)
+    {
+      if (llama_set_adapter_lora(ctx, item.first->adapter, item.second) != 0)
+      {
+        throw std::runtime_error("Failed to apply adapter " + item.first->path);
+      }
+    }
+  }
+
+  static void release(const std::vector<LlamaAdapter *> &adapters)
+  {
+    for (const auto adapter : adapters)
+    {
+      adapter->attached--;
+      adapter->Unref();
+    }
+  }
+};
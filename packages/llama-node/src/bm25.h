@@ -0,0 +1,588 @@
+//
+//  bm25.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+#include "common.h"
+#include "worker.h"
+#include "simd.h"
+
+static inline void llama_node_varint_put(std::vector<uint8_t> &out, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static inline uint32_t llama_node_varint_get(const uint8_t *&p)
+{
+  uint32_t value = 0;
+  int shift = 0;
+  while (*p & 0x80)
+  {
+    value |= (uint32_t)(*p++ & 0x7F) << shift;
+    shift += 7;
+  }
+  value |= (uint32_t)(*p++) << shift;
+  return value;
+}
+
+// Terms of a text for indexing without a model: runs of ASCII letters and digits, lowercased, and
+// runs of non ASCII bytes, hashed with FNV-1a.
+static std::vector<uint32_t> llama_node_word_terms(const std::string &text)
+{
+  std::vector<uint32_t> terms;
+  uint32_t hash = 2166136261u;
+  bool in_word = false;
+  for (size_t i = 0; i <= text.size(); ++i)
+  {
+    const unsigned char c = i < text.size() ? text[i] : 0;
+    const bool word = std::isalnum(c) || c >= 0x80;
+    if (word)
+    {
+      hash = (hash ^ (unsigned char)std::tolower(c)) * 16777619u;
+      in_word = true;
+    }
+    else if (in_word)
+    {
+      terms.push_back(hash);
+      hash = 2166136261u;
+      in_word = false;
+    }
+  }
+  return terms;
+}
+
+struct llama_node_posting_list
+{
+  // (doc id delta, term frequency) pairs as varints, in doc id order
+  std::vector<uint8_t> data;
+  uint32_t count = 0;
+  uint32_t last_doc = 0;
+  // for the score upper bound of WAND
+  uint32_t max_tf = 0;
+  uint32_t min_len = UINT32_MAX;
+};
+
+struct llama_node_search_hit
+{
+  uint32_t doc;
+  float score;
+  bool operator<(const llama_node_search_hit &other) const
+  {
+    return score > other.score;
+  }
+};
+
+// Inverted index scored with BM25, with optional dense vectors per document for hybrid queries.
+class LlamaBM25Index : public Napi::ObjectWrap<LlamaBM25Index>
+{
+public:
+  std::mutex mutex;
+  // read by stats without the mutex
+  std::atomic<size_t> n_documents{0};
+  std::atomic<size_t> n_terms{0};
+  std::atomic<size_t> posting_bytes{0};
+  std::atomic<size_t> vector_bytes{0};
+  std::unordered_map<uint32_t, llama_node_posting_list> postings;
+  std::vector<uint32_t> lengths;
+  uint64_t total_length = 0;
+  std::vector<float> vectors;
+  size_t dimensions = 0;
+  float k1 = 1.2f;
+  float b = 0.75f;
+
+  LlamaBM25Index(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaBM25Index>(info)
+  {
+    Napi::Object options = info[0].As<Napi::Object>();
+    if (options.Has("k1"))
+    {
+      k1 = options.Get("k1").As<Napi::Number>().FloatValue();
+    }
+    if (options.Has("b"))
+    {
+      b = options.Get("b").As<Napi::Number>().FloatValue();
+    }
+  }
+
+  static std::vector<uint32_t> terms(const Napi::Value &value)
+  {
+    if (value.IsString())
+    {
+      return llama_node_word_terms(value.As<Napi::String>().Utf8Value());
+    }
+    Napi::Uint32Array tokens = value.As<Napi::Uint32Array>();
+    return std::vector<uint32_t>(tokens.Data(), tokens.Data() + tokens.ElementLength());
+  }
+
+  // Documents get consecutive ids from the number of documents before, which is resolved.
+  Napi::Value Add(const Napi::CallbackInfo &info)
+  {
+    Napi::Array documents = info[0].As<Napi::Array>();
+    auto docs = std::make_shared<std::vector<std::vector<uint32_t>>>();
+    for (uint32_t i = 0; i < documents.Length(); ++i)
+    {
+      docs->push_back(terms(documents.Get(i)));
+    }
+
+    auto dense = std::make_shared<std::vector<float>>();
+    size_t dim = 0;
+    if (info.Length() > 1 && info[1].IsArray())
+    {
+      Napi::Array _vectors = info[1].As<Napi::Array>();
+      if (_vectors.Length() != documents.Length())
+      {
+        Napi::Error::New(Env(), "Number of vectors differs from the number of documents").ThrowAsJavaScriptException();
+        return Env().Undefined();
+      }
+      for (uint32_t i = 0; i < _vectors.Length(); ++i)
+      {
+        Napi::Float32Array vector = _vectors.Get(i).As<Napi::Float32Array>();
+        if (i == 0)
+        {
+          dim = vector.ElementLength();
+        }
+        if (vector.ElementLength() != dim)
+        {
+          Napi::Error::New(Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+          return Env().Undefined();
+        }
+        dense->insert(dense->end(), vector.Data(), vector.Data() + dim);
+      }
+    }
+    this->Ref();
+
+    auto worker = new _AsyncWorkerWithResult<uint32_t>(
+        Env(),
+        [=]()
+        {
+          // term frequencies of each document, counted in parallel
+          std::vector<std::vector<std::pair<uint32_t, uint32_t>>> counts(docs->size());
+          const size_t n_threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), docs->size() / 64));
+          std::vector<std::thread> threads;
+          for (size_t t = 0; t < n_threads; ++t)
+          {
+            threads.emplace_back([&, t]()
+                                 {
+              for (size_t i = t; i < docs->size(); i += n_threads)
+              {
+                std::vector<uint32_t> sorted((*docs)[i]);
+                std::sort(sorted.begin(), sorted.end());
+                for (size_t j = 0; j < sorted.size(); ++j)
+                {
+                  if (j == 0 || sorted[j] != sorted[j - 1])
+                  {
+                    counts[i].emplace_back(sorted[j], 1);
+                  }
+                  else
+                  {
+                    counts[i].back().second++;
+                  }
+                }
+              } });
+          }
+          for (auto &thread : threads)
+          {
+            thread.join();
+          }
+
+          std::lock_guard<std::mutex> lock(mutex);
+          if (dim != 0 && dimensions == 0 && lengths.empty())
+          {
+            dimensions = dim;
+          }
+          if (dim != dimensions)
+          {
+            throw std::runtime_error(dim == 0 ? "Documents of a hybrid index need vectors" : "Documents without vectors were added before");
+          }
+          const uint32_t first = lengths.size();
+          size_t bytes = 0;
+          for (size_t i = 0; i < docs->size(); ++i)
+          {
+            const uint32_t doc = first + i;
+            const uint32_t length = (*docs)[i].size();
+            for (const auto &count : counts[i])
+            {
+              auto &list = postings[count.first];
+              bytes -= list.data.size();
+              llama_node_varint_put(list.data, list.count == 0 ? doc : doc - list.last_doc);
+              llama_node_varint_put(list.data, count.second);
+              list.count++;
+              list.last_doc = doc;
+              list.max_tf = std::max(list.max_tf, count.second);
+              list.min_len = std::min(list.min_len, length);
+              bytes += list.data.size();
+            }
+            lengths.push_back(length);
+            total_length += length;
+          }
+          vectors.insert(vectors.end(), dense->begin(), dense->end());
+          n_documents = lengths.size();
+          n_terms = postings.size();
+          posting_bytes += bytes;
+          vector_bytes = vectors.size() * sizeof(float);
+          return first;
+        },
+        [=](Napi::Env env, uint32_t result)
+        {
+          return Napi::Number::New(env, result);
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  struct cursor
+  {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t doc;
+    uint32_t tf;
+    float idf;
+    float bound;
+
+    bool next()
+    {
+      if (p == end)
+      {
+        doc = UINT32_MAX;
+        return false;
+      }
+      doc += llama_node_varint_get(p);
+      tf = llama_node_varint_get(p);
+      return true;
+    }
+  };
+
+  float term_score(uint32_t tf, uint32_t length, float idf, float avg_length) const
+  {
+    return idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * length / avg_length));
+  }
+
+  // Top k documents by BM25 with WAND: documents are only scored when the upper bounds of the
+  // terms they may contain can beat the k-th score so far. The caller holds the mutex.
+  std::vector<llama_node_search_hit> search(const std::vector<uint32_t> &query, size_t k) const
+  {
+    std::vector<llama_node_search_hit> heap;
+    if (lengths.empty() || k == 0)
+    {
+      return heap;
+    }
+    const float n_docs = lengths.size();
+    const float avg_length = std::max(1.0f, (float)total_length / n_docs);
+
+    std::unordered_map<uint32_t, uint32_t> weights;
+    for (auto term : query)
+    {
+      weights[term]++;
+    }
+    std::vector<cursor> cursors;
+    for (const auto &weight : weights)
+    {
+      auto it = postings.find(weight.first);
+      if (it == postings.end())
+      {
+        continue;
+      }
+      const auto &list = it->second;
+      const float idf = weight.second * std::log(1 + (n_docs - list.count + 0.5f) / (list.count + 0.5f));
+      cursor c = {list.data.data(), list.data.data() + list.data.size(), 0, 0, idf, 0};
+      c.bound = term_score(list.max_tf, list.min_len, idf, avg_length);
+      c.next();
+      cursors.push_back(c);
+    }
+
+    float threshold = 0;
+    while (true)
+    {
+      std::sort(cursors.begin(), cursors.end(), [](const cursor &a, const cursor &b)
+                { return a.doc < b.doc; });
+      while (!cursors.empty() && cursors.back().doc == UINT32_MAX)
+      {
+        cursors.pop_back();
+      }
+
+      float bound = 0;
+      size_t pivot = cursors.size();
+      for (size_t i = 0; i < cursors.size(); ++i)
+      {
+        bound += cursors[i].bound;
+        if (bound > threshold || heap.size() < k)
+        {
+          pivot = i;
+          break;
+        }
+      }
+      if (pivot == cursors.size())
+      {
+        break;
+      }
+
+      const uint32_t doc = cursors[pivot].doc;
+      if (cursors[0].doc == doc)
+      {
+        float score = 0;
+        for (auto &c : cursors)
+        {
+          if (c.doc != doc)
+          {
+            break;
+          }
+          score += term_score(c.tf, lengths[doc], c.idf, avg_length);
+          c.next();
+        }
+        if (heap.size() < k)
+        {
+          heap.push_back({doc, score});
+          std::push_heap(heap.begin(), heap.end());
+        }
+        else if (score > heap.front().score)
+        {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.back() = {doc, score};
+          std::push_heap(heap.begin(), heap.end());
+        }
+        if (heap.size() == k)
+        {
+          threshold = heap.front().score;
+        }
+      }
+      else
+      {
+        for (size_t i = 0; i < pivot; ++i)
+        {
+          while (cursors[i].doc < doc && cursors[i].next())
+          {
+          }
+        }
+      }
+    }
+
+    std::sort_heap(heap.begin(), heap.end());
+    return heap;
+  }
+
+  std::vector<llama_node_search_hit> nearest(const float *query, size_t k) const
+  {
+    std::vector<llama_node_search_hit> heap;
+    const size_t n_docs = dimensions == 0 ? 0 : vectors.size() / dimensions;
+    for (size_t doc = 0; doc < n_docs; ++doc)
+    {
+      const float score = llama_node_dot(query, vectors.data() + doc * dimensions, dimensions);
+      if (heap.size() < k)
+      {
+        heap.push_back({(uint32_t)doc, score});
+        std::push_heap(heap.begin(), heap.end());
+      }
+      else if (score > heap.front().score)
+      {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {(uint32_t)doc, score};
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+    std::sort_heap(heap.begin(), heap.end());
+    return heap;
+  }
+
+  static Napi::Value getNapiHits(Napi::Env env, const std::vector<llama_node_search_hit> &hits)
+  {
+    Napi::Object result = Napi::Object::New(env);
+    Napi::Uint32Array ids = Napi::Uint32Array::New(env, hits.size());
+    Napi::Float32Array scores = Napi::Float32Array::New(env, hits.size());
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+      ids[i] = hits[i].doc;
+      scores[i] = hits[i].score;
+    }
+    result.Set("ids", ids);
+    result.Set("scores", scores);
+    return result;
+  }
+
+  // Searches are queued after the adds before them, so they never wait on the JS thread.
+  Napi::Value queueSearch(std::function<std::vector<llama_node_search_hit>()> execute)
+  {
+    this->Ref();
+
+    auto worker = new _AsyncWorkerWithResult<std::shared_ptr<std::vector<llama_node_search_hit>>>(
+        Env(),
+        [=]()
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          return std::make_shared<std::vector<llama_node_search_hit>>(execute());
+        },
+        [=](Napi::Env env, std::shared_ptr<std::vector<llama_node_search_hit>> result) -> napi_value
+        {
+          return getNapiHits(env, *result);
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  Napi::Value Search(const Napi::CallbackInfo &info)
+  {
+    const auto query = terms(info[0]);
+    const size_t k = info[1].As<Napi::Number>().Uint32Value();
+    return queueSearch([=]()
+                       { return search(query, k); });
+  }
+
+  // Fuses the BM25 and the dot product rankings of the top `candidates` of each, by reciprocal
+  // rank or by a weighted sum of min-max normalized scores.
+  Napi::Value Hybrid(const Napi::CallbackInfo &info)
+  {
+    const auto query = terms(info[0]);
+    Napi::Float32Array _vector = info[1].As<Napi::Float32Array>();
+    const std::vector<float> vector(_vector.Data(), _vector.Data() + _vector.ElementLength());
+    Napi::Object options = info[2].As<Napi::Object>();
+
+    const size_t k = options.Has("k") ? options.Get("k").As<Napi::Number>().Uint32Value() : 10;
+    const size_t candidates = std::max(k, options.Has("candidates") ? (size_t)options.Get("candidates").As<Napi::Number>().Uint32Value() : k * 10);
+    const bool weighted = options.Has("fusion") && options.Get("fusion").As<Napi::String>().Utf8Value() == "weighted";
+    const float alpha = options.Has("alpha") ? options.Get("alpha").As<Napi::Number>().FloatValue() : 0.5f;
+    const float rrf_k = options.Has("rrfK") ? options.Get("rrfK").As<Napi::Number>().FloatValue() : 60.0f;
+
+    return queueSearch([=]()
+                       {
+      if (dimensions == 0)
+      {
+        throw std::runtime_error("Index has no vectors");
+      }
+      if (vector.size() != dimensions)
+      {
+        throw std::runtime_error("Invalid comparison of vectors of different lengths");
+      }
+
+      const std::vector<llama_node_search_hit> lists[2] = {search(query, candidates), nearest(vector.data(), candidates)};
+      const float weights[2] = {alpha, 1 - alpha};
+
+      std::unordered_map<uint32_t, float> fused;
+      for (int l = 0; l < 2; ++l)
+      {
+        const auto &hits = lists[l];
+        if (hits.empty())
+        {
+          continue;
+        }
+        const float max = hits.front().score;
+        const float min = hits.back().score;
+        for (size_t rank = 0; rank < hits.size(); ++rank)
+        {
+          fused[hits[rank].doc] += weighted
+                                       ? weights[l] * (max > min ? (hits[rank].score - min) / (max - min) : 1)
+                                       : 1 / (rrf_k + rank + 1);
+        }
+      }
+
+      std::vector<llama_node_search_hit> hits;
+      for (const auto &item : fused)
+      {
+        hits.push_back({item.first, item.second});
+      }
+      std::sort(hits.begin(), hits.end(), [](const llama_node_search_hit &a, const llama_node_search_hit &b)
+                { return a.score != b.score ? a.score > b.score : a.doc < b.doc; });
+      if (hits.size() > k)
+      {
+        hits.resize(k);
+      }
+      return hits; });
+  }
+
+  Napi::Value Stats(const Napi::CallbackInfo &info)
+  {
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("documents", Napi::Number::From(Env(), n_documents.load()));
+    result.Set("terms", Napi::Number::From(Env(), n_terms.load()));
+    result.Set("postingBytes", Napi::Number::From(Env(), posting_bytes.load()));
+    result.Set("vectorBytes", Napi::Number::From(Env(), vector_bytes.load()));
+    return result;
+  }
+
+  // Queued after the operations before it, like searches, so it never waits on the JS thread.
+  Napi::Value Dispose(const Napi::CallbackInfo &info)
+  {
+    this->Ref();
+
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          std::unordered_map<uint32_t, llama_node_posting_list>().swap(postings);
+          std::vector<uint32_t>().swap(lengths);
+          std::vector<float>().swap(vectors);
+          total_length = 0;
+          dimensions = 0;
+          n_documents = 0;
+          n_terms = 0;
+          posting_bytes = 0;
+          vector_bytes = 0;
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  static void init(Napi::Object exports)
+  {
+    auto def = DefineClass(
+        exports.Env(),
+        "LlamaBM25Index",
+        {
+            InstanceMethod("add", &LlamaBM25Index::Add),
+            InstanceMethod("search", &LlamaBM25Index::Search),
+            InstanceMethod("hybrid", &LlamaBM25Index::Hybrid),
+            InstanceMethod("stats", &LlamaBM25Index::Stats),
+            InstanceMethod("dispose", &LlamaBM25Index::Dispose),
+        });
+    exports.Set("LlamaBM25Index", def);
+  }
+};
@@ -0,0 +1,185 @@
+//
+//  budget.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <mutex>
+
+#include "common.h"
+#include "memory.h"
+#include "executor.h"
+
+// Device wide limit of the KV cache contexts may allocate.
+class llama_node_kv_budget
+{
+public:
+  static llama_node_kv_budget &shared()
+  {
+    static llama_node_kv_budget budget;
+    return budget;
+  }
+
+  bool reserve(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (max_bytes > 0 && reserved + bytes > max_bytes)
+    {
+      rejected++;
+      return false;
+    }
+    reserved += bytes;
+    contexts++;
+    return true;
+  }
+
+  void release(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reserved -= std::min(reserved, bytes);
+    contexts--;
+  }
+
+  bool grow(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (max_bytes > 0 && reserved + bytes > max_bytes)
+    {
+      rejected++;
+      return false;
+    }
+    reserved += bytes;
+    return true;
+  }
+
+  void shrink(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reserved -= std::min(reserved, bytes);
+  }
+
+  std::mutex mutex;
+  size_t max_bytes = 0;
+  size_t reserved = 0;
+  size_t contexts = 0;
+  uint64_t rejected = 0;
+};
+
+// The KV bytes held by one context against the device budget.
+struct llama_node_kv_reservation
+{
+  size_t bytes = 0;
+  bool reserved = false;
+
+  bool reserve(const llama_model *model, const llama_context_params &params)
+  {
+    const uint32_t n_ctx = params.n_ctx > 0 ? params.n_ctx : llama_model_n_ctx_train(model);
+    bytes = n_ctx * llama_node_kv_bytes_per_token(model, params);
+    reserved = llama_node_kv_budget::shared().reserve(bytes);
+    return reserved;
+  }
+
+  void release()
+  {
+    if (!reserved)
+    {
+      return;
+    }
+    llama_node_kv_budget::shared().release(bytes + growth);
+    reserved = false;
+    growth = 0;
+  }
+
+  // A resize holds the current bytes and reserves any growth on top, until it is committed or rolled back.
+  size_t growth = 0;
+
+  bool prepare(const llama_model *model, const llama_context_params &params, size_t &next_bytes)
+  {
+    const uint32_t n_ctx = params.n_ctx > 0 ? params.n_ctx : llama_model_n_ctx_train(model);
+    next_bytes = n_ctx * llama_node_kv_bytes_per_token(model, params);
+    growth = next_bytes > bytes ? next_bytes - bytes : 0;
+    if (growth > 0 && !llama_node_kv_budget::shared().grow(growth))
+    {
+      growth = 0;
+      return false;
+    }
+    return true;
+  }
+
+  void commit(size_t next_bytes)
+  {
+    llama_node_kv_budget::shared().shrink(bytes + growth - next_bytes);
+    bytes = next_bytes;
+    growth = 0;
+  }
+
+  void rollback()
+  {
+    llama_node_kv_budget::shared().shrink(growth);
+    growth = 0;
+  }
+};
+
+static void llama_node_throw_budget_exceeded(Napi::Env env, size_t bytes)
+{
+  auto &budget = llama_node_kv_budget::shared();
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  Napi::Error error = Napi::Error::New(env, "KV cache budget exceeded: " + std::to_string(bytes) + " bytes requested, " + std::to_string(budget.max_bytes - std::min(budget.max_bytes, budget.reserved)) + " bytes available");
+  error.Value().Set("code", Napi::String::New(env, "ERR_BUDGET_EXCEEDED"));
+  error.ThrowAsJavaScriptException();
+}
+
+Napi::Value setBudget(const Napi::CallbackInfo &info)
+{
+  Napi::Object options = info[0].As<Napi::Object>();
+  if (options.Has("maxKvBytes"))
+  {
+    auto &budget = llama_node_kv_budget::shared();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    budget.max_bytes = options.Get("maxKvBytes").As<Napi::Number>().Int64Value();
+  }
+  if (options.Has("maxConcurrentDecodes"))
+  {
+    llama_node_executor::shared().setMaxDecodes(options.Get("maxConcurrentDecodes").As<Napi::Number>().Uint32Value());
+  }
+  return info.Env().Undefined();
+}
+
+Napi::Value getBudgetStats(const Napi::CallbackInfo &info)
+{
+  Napi::Object result = Napi::Object::New(info.Env());
+  {
+    auto &budget = llama_node_kv_budget::shared();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    result.Set("maxKvBytes", Napi::Number::From(info.Env(), budget.max_bytes));
+    result.Set("kvReserved", Napi::Number::From(info.Env(), budget.reserved));
+    result.Set("contexts", Napi::Number::From(info.Env(), budget.contexts));
+    result.Set("rejected", Napi::Number::From(info.Env(), budget.rejected));
+  }
+  const auto stats = llama_node_executor::shared().getStats();
+  result.Set("maxConcurrentDecodes", Napi::Number::From(info.Env(), stats.max_decodes));
+  result.Set("decoding", Napi::Number::From(info.Env(), stats.decoding));
+  result.Set("queued", Napi::Number::From(info.Env(), stats.queued));
+  return result;
+}
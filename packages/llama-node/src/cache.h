@@ -0,0 +1,407 @@
+//
+//  cache.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <list>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "common.h"
+#include "hash.h"
+#include "model.h"
+
+// A read only mapping of an append only file.
+class llama_node_mapped_file
+{
+public:
+  ~llama_node_mapped_file()
+  {
+    unmap();
+  }
+
+  const uint8_t *data(size_t offset, size_t length, const std::string &path)
+  {
+    if (offset + length > size)
+    {
+      unmap();
+      map(path);
+    }
+    return offset + length > size ? NULL : addr + offset;
+  }
+
+  void unmap()
+  {
+    if (addr == NULL)
+    {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(addr);
+#else
+    munmap(addr, size);
+#endif
+    addr = NULL;
+    size = 0;
+  }
+
+private:
+  uint8_t *addr = NULL;
+  size_t size = 0;
+
+  void map(const std::string &path)
+  {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      return;
+    }
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+    {
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping != NULL)
+      {
+        addr = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = addr != NULL ? (size_t)length.QuadPart : 0;
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapped != MAP_FAILED)
+      {
+        addr = (uint8_t *)mapped;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+};
+
+class LlamaEmbeddingCache : public Napi::ObjectWrap<LlamaEmbeddingCache>
+{
+public:
+  struct entry
+  {
+    llama_node_hash128 key;
+    std::vector<float> vector;
+  };
+
+  struct disk_entry
+  {
+    size_t offset;
+    uint32_t length;
+  };
+
+  // Most recently used first.
+  std::list<entry> entries;
+  std::unordered_map<llama_node_hash128, std::list<entry>::iterator, llama_node_hash128_hasher> index;
+  size_t bytes = 0;
+  size_t max_bytes = 64 * 1024 * 1024;
+
+  std::string path;
+  FILE *file = NULL;
+  llama_node_mapped_file mapped;
+  std::unordered_map<llama_node_hash128, disk_entry, llama_node_hash128_hasher> disk_index;
+  size_t disk_bytes = 0;
+  size_t max_disk_bytes = 0;
+  bool writable = true;
+
+  uint64_t hits = 0;
+  uint64_t disk_hits = 0;
+  uint64_t misses = 0;
+
+  static const uint32_t disk_magic = 0x4345454c; // "LEEC"
+
+  LlamaEmbeddingCache(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaEmbeddingCache>(info)
+  {
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    if (options.Has("maxBytes"))
+    {
+      max_bytes = options.Get("maxBytes").As<Napi::Number>().Int64Value();
+    }
+    if (options.Has("maxDiskBytes"))
+    {
+      max_disk_bytes = options.Get("maxDiskBytes").As<Napi::Number>().Int64Value();
+    }
+    if (options.Has("path"))
+    {
+      path = options.Get("path").As<Napi::String>().Utf8Value();
+      if (!openDisk())
+      {
+        Napi::Error::New(Env(), "Failed to open embedding cache " + path).ThrowAsJavaScriptException();
+        return;
+      }
+    }
+  }
+
+  ~LlamaEmbeddingCache()
+  {
+    dispose();
+  }
+
+  void dispose()
+  {
+    mapped.unmap();
+    if (file != NULL)
+    {
+      fclose(file);
+      file = NULL;
+    }
+    disk_index.clear();
+    entries.clear();
+    index.clear();
+    bytes = 0;
+  }
+
+  // Records are appended as a 16 byte key, a length and the vector. A truncated tail is ignored.
+  bool openDisk()
+  {
+    file = fopen(path.c_str(), "a+b");
+    if (file == NULL)
+    {
+      return false;
+    }
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    const size_t size = _ftelli64(file);
+#else
+    fseeko(file, 0, SEEK_END);
+    const size_t size = ftello(file);
+#endif
+    if (size == 0)
+    {
+      writable = fwrite(&disk_magic, sizeof(disk_magic), 1, file) == 1 && fflush(file) == 0;
+      disk_bytes = sizeof(disk_magic);
+      return true;
+    }
+
+    const uint8_t *data = mapped.data(0, size, path);
+    uint32_t magic = 0;
+    if (data == NULL || size < sizeof(magic) || (memcpy(&magic, data, sizeof(magic)), magic != disk_magic))
+    {
+      return false;
+    }
+
+    size_t offset = sizeof(magic);
+    const size_t header = sizeof(llama_node_hash128) + sizeof(uint32_t);
+    while (offset + header <= size)
+    {
+      llama_node_hash128 key;
+      uint32_t length;
+      memcpy(&key, data + offset, sizeof(key));
+      memcpy(&length, data + offset + sizeof(key), sizeof(length));
+      if (offset + header + length * sizeof(float) > size)
+      {
+        break;
+      }
+      disk_entry item;
+      item.offset = offset + header;
+      item.length = length;
+      disk_index[key] = item;
+      offset += header + length * sizeof(float);
+    }
+    disk_bytes = offset;
+    // Appending after a torn record would misalign everything written later.
+    writable = offset == size;
+    return true;
+  }
+
+  void insert(const llama_node_hash128 &key, std::vector<float> vector)
+  {
+    const size_t size = vector.size() * sizeof(float);
+    if (size > max_bytes)
+    {
+      return;
+    }
+    auto found = index.find(key);
+    if (found != index.end())
+    {
+      bytes -= found->second->vector.size() * sizeof(float);
+      entries.erase(found->second);
+      index.erase(found);
+    }
+    while (!entries.empty() && bytes + size > max_bytes)
+    {
+      bytes -= entries.back().vector.size() * sizeof(float);
+      index.erase(entries.back().key);
+      entries.pop_back();
+    }
+    entry item;
+    item.key = key;
+    item.vector.swap(vector);
+    entries.push_front(item);
+    index[key] = entries.begin();
+    bytes += size;
+  }
+
+  void write(const llama_node_hash128 &key, const float *vector, uint32_t length)
+  {
+    const size_t size = sizeof(key) + sizeof(length) + length * sizeof(float);
+    if (file == NULL || !writable || disk_index.count(key) != 0 || (max_disk_bytes > 0 && disk_bytes + size > max_disk_bytes))
+    {
+      return;
+    }
+    // a short write leaves a torn record, nothing can be appended after it
+    if (fwrite(&key, sizeof(key), 1, file) != 1 ||
+        fwrite(&length, sizeof(length), 1, file) != 1 ||
+        fwrite(vector, sizeof(float), length, file) != length ||
+        fflush(file) != 0)
+    {
+      writable = false;
+      return;
+    }
+
+    disk_entry item;
+    item.offset = disk_bytes + sizeof(key) + sizeof(length);
+    item.length = length;
+    disk_index[key] = item;
+    disk_bytes += size;
+  }
+
+  llama_node_hash128 key(const Napi::CallbackInfo &info)
+  {
+    auto model = Napi::ObjectWrap<LlamaModel>::Unwrap(info[0].As<Napi::Object>());
+    Napi::Uint32Array tokens = info[1].As<Napi::Uint32Array>();
+    int32_t options[3] = {
+        info[2].As<Napi::Number>().Int32Value(),
+        info[3].As<Napi::Number>().Int32Value(),
+        info[4].As<Napi::Number>().Int32Value(),
+    };
+    auto hash = model->identity;
+    hash = llama_node_hash(tokens.Data(), tokens.ElementLength() * sizeof(uint32_t), hash);
+    return llama_node_hash(options, sizeof(options), hash);
+  }
+
+  Napi::Value Get(const Napi::CallbackInfo &info)
+  {
+    const auto hash = key(info);
+
+    auto found = index.find(hash);
+    if (found != index.end())
+    {
+      entries.splice(entries.begin(), entries, found->second);
+      hits++;
+      const auto &vector = found->second->vector;
+      Napi::Float32Array result = Napi::Float32Array::New(Env(), vector.size());
+      std::copy(vector.begin(), vector.end(), result.Data());
+      return result;
+    }
+
+    auto disk = disk_index.find(hash);
+    if (disk != disk_index.end())
+    {
+      const uint8_t *data = mapped.data(disk->second.offset, disk->second.length * sizeof(float), path);
+      if (data != NULL)
+      {
+        disk_hits++;
+        Napi::Float32Array result = Napi::Float32Array::New(Env(), disk->second.length);
+        memcpy(result.Data(), data, disk->second.length * sizeof(float));
+        insert(hash, std::vector<float>(result.Data(), result.Data() + disk->second.length));
+        return result;
+      }
+    }
+
+    misses++;
+    return Env().Undefined();
+  }
+
+  Napi::Value Set(const Napi::CallbackInfo &info)
+  {
+    const auto hash = key(info);
+    Napi::Float32Array vector = info[5].As<Napi::Float32Array>();
+    const float *data = vector.Data();
+    const size_t length = vector.ElementLength();
+
+    insert(hash, std::vector<float>(data, data + length));
+    write(hash, data, length);
+    return Env().Undefined();
+  }
+
+  Napi::Value Clear(const Napi::CallbackInfo &info)
+  {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+    return Env().Undefined();
+  }
+
+  Napi::Value Stats(const Napi::CallbackInfo &info)
+  {
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("entries", Napi::Number::From(Env(), entries.size()));
+    result.Set("bytes", Napi::Number::From(Env(), bytes));
+    result.Set("diskEntries", Napi::Number::From(Env(), disk_index.size()));
+    result.Set("diskBytes", Napi::Number::From(Env(), file != NULL ? disk_bytes : 0));
+    result.Set("hits", Napi::Number::From(Env(), hits));
+    result.Set("diskHits", Napi::Number::From(Env(), disk_hits));
+    result.Set("misses", Napi::Number::From(Env(), misses));
+    return result;
+  }
+
+  Napi::Value Dispose(const Napi::CallbackInfo &info)
+  {
+    dispose();
+    return Env().Undefined();
+  }
+
+  static void init(Napi::Object exports)
+  {
+    auto def = DefineClass(
+        exports.Env(),
+        "LlamaEmbeddingCache",
+        {
+            InstanceMethod("get", &LlamaEmbeddingCache::Get),
+            InstanceMethod("set", &LlamaEmbeddingCache::Set),
+            InstanceMethod("clear", &LlamaEmbeddingCache::Clear),
+            InstanceMethod("stats", &LlamaEmbeddingCache::Stats),
+            InstanceMethod("dispose", &LlamaEmbeddingCache::Dispose),
+        });
+    exports.Set("LlamaEmbeddingCache", def);
+  }
+};
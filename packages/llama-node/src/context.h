@@ -28,12 +28,18 @@
 #include "common.h"
 #include "model.h"
 #include "worker.h"
+#include "perf.h"
+#include "threadpool.h"
+#include "budget.h"
+#include "adapter.h"
+#include "grammar.h"
 
 class LlamaContextSampler : public Napi::ObjectWrap<LlamaContextSampler>
 {
 public:
   LlamaModel *model;
   llama_sampler *sampler;
+  llama_node_grammar grammar;
 
   LlamaContextSampler(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaContextSampler>(info)
   {
@@ -109,8 +115,13 @@ public:
 
     if (options.Has("grammar"))
     {
-      std::string grammar = options.Get("grammar").As<Napi::String>().Utf8Value();
-      llama_sampler_chain_add(sampler, llama_sampler_init_grammar(llama_model_get_vocab(model->model), grammar.c_str(), "root"));
+      // kept out of the chain, see llama_node_grammar
+      grammar.init(model->model, model->identity, options.Get("grammar").As<Napi::String>().Utf8Value());
+      if (grammar.sampler == NULL)
+      {
+        Napi::Error::New(Env(), "Failed to parse grammar").ThrowAsJavaScriptException();
+        return;
+      }
     }
 
     if (temperature <= 0)
@@ -144,16 +155,30 @@ public:
     }
     llama_sampler_free(sampler);
     sampler = NULL;
+    grammar.release();
     model->Unref();
   }
 
   Napi::Value AcceptToken(const Napi::CallbackInfo &info)
   {
     llama_token tokenId = info[0].As<Napi::Number>().Int32Value();
-    llama_sampler_accept(sampler, tokenId);
+    if (grammar.sampler != NULL)
+    {
+      grammar.accept(sampler, tokenId);
+    }
+    else
+    {
+      llama_sampler_accept(sampler, tokenId);
+    }
     return info.Env().Undefined();
   }
 
+  Napi::Value AllowsToken(const Napi::CallbackInfo &info)
+  {
+    llama_token tokenId = info[0].As<Napi::Number>().Int32Value();
+    return Napi::Boolean::New(info.Env(), grammar.sampler == NULL || grammar.allows(tokenId));
+  }
+
   static void init(Napi::Object exports)
   {
     auto def = DefineClass(
@@ -161,6 +186,7 @@ public:
         "LlamaContextSampler",
         {
             InstanceMethod("acceptToken", &LlamaContextSampler::AcceptToken),
+            InstanceMethod("allowsToken", &LlamaContextSampler::AllowsToken),
         });
     exports.Set("LlamaContextSampler", def);
   }
@@ -171,12 +197,22 @@ class LlamaContext : public Napi::ObjectWrap<LlamaContext>
 public:
   LlamaModel *model;
   llama_context_params params;
-  llama_context *ctx;
+  llama_context *ctx = NULL;
+  ExternalMemory memory;
+  llama_node_perf_counters perf;
+  llama_node_threadpools threadpools;
+  llama_node_kv_reservation reservation;
+  llama_node_adapters adapters;
+  int32_t priority = 0;
+  std::atomic<bool> aborted{false};
+
+  // Only touched on the JS thread.
+  bool resizing = false;
+  uint32_t n_ctx = 0;
 
   LlamaContext(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaContext>(info)
   {
     model = Napi::ObjectWrap<LlamaModel>::Unwrap(info[0].As<Napi::Object>());
-    model->Ref();
 
     auto hardware_concurrency = std::thread::hardware_concurrency();
 
@@ -185,6 +221,7 @@ public:
     params.n_seq_max = 1;
     params.n_threads = hardware_concurrency;
     params.n_threads_batch = hardware_concurrency;
+    params.no_perf = false;
 
     Napi::Object options = info[1].As<Napi::Object>();
 
@@ -204,6 +241,11 @@ public:
       params.flash_attn = options.Get("flashAttention").As<Napi::Boolean>().Value();
     }
 
+    if (options.Has("defragThreshold"))
+    {
+      params.defrag_thold = options.Get("defragThreshold").As<Napi::Number>().FloatValue();
+    }
+
     if (options.Has("threads"))
     {
       const auto n_threads = options.Get("threads").As<Napi::Number>().Uint32Value();
@@ -212,13 +254,40 @@ public:
       params.n_threads_batch = resolved_n_threads;
     }
 
+    if (options.Has("priority"))
+    {
+      priority = options.Get("priority").As<Napi::Number>().Int32Value();
+    }
+
+    if (options.Has("sequences"))
+    {
+      params.n_seq_max = std::max(1u, options.Get("sequences").As<Napi::Number>().Uint32Value());
+      params.kv_unified = true;
+    }
+
+    if (!reservation.reserve(model->model, params))
+    {
+      llama_node_throw_budget_exceeded(Env(), reservation.bytes);
+      return;
+    }
+
+    threadpools.init(options, params);
+
     ctx = llama_init_from_model(model->model, params);
     if (ctx == NULL)
     {
+      reservation.release();
+      threadpools.release();
       Napi::Error::New(Env(), "Failed to load context").ThrowAsJavaScriptException();
+      return;
     }
+    // only a created context is disposed, which releases the model
+    model->Ref();
+    threadpools.attach(ctx);
+    llama_set_abort_callback(ctx, abortCallback, this);
+    n_ctx = llama_n_ctx(ctx);
 
-    Napi::MemoryManagement::AdjustExternalMemory(Env(), llama_state_get_size(ctx));
+    updateMemory();
   }
 
   ~LlamaContext()
@@ -232,14 +301,45 @@ public:
     {
       return;
     }
-    Napi::MemoryManagement::AdjustExternalMemory(Env(), -(int64_t)llama_state_get_size(ctx));
+    memory.release(Env());
     llama_free(ctx);
     ctx = NULL;
+    threadpools.release();
+    reservation.release();
+    llama_node_adapters::release(adapters.clear());
     model->Unref();
   }
 
+  void updateMemory()
+  {
+    if (resizing)
+    {
+      return;
+    }
+    memory.update(Env(), llama_node_context_memory_usage(ctx, model->params, params));
+  }
+
+  // Polled by the backends between graph nodes, so an abort stops a decode within milliseconds.
+  static bool abortCallback(void *data)
+  {
+    return static_cast<LlamaContext *>(data)->aborted.load();
+  }
+
+  bool throwIfResizing()
+  {
+    if (resizing)
+    {
+      Napi::Error::New(Env(), "Context is being resized").ThrowAsJavaScriptException();
+    }
+    return resizing;
+  }
+
   Napi::Value Dispose(const Napi::CallbackInfo &info)
   {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
     if (ctx != NULL)
     {
       dispose();
@@ -249,16 +349,24 @@ public:
 
   Napi::Value GetContextSize(const Napi::CallbackInfo &info)
   {
-    return Napi::Number::From(Env(), llama_n_ctx(ctx));
+    return Napi::Number::From(Env(), n_ctx);
   }
 
   Napi::Value GetBatchSize(const Napi::CallbackInfo &info)
   {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
     return Napi::Number::From(Env(), llama_n_batch(ctx));
   }
 
   Napi::Value GetStateSize(const Napi::CallbackInfo &info)
   {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
     return Napi::Number::From(Env(), llama_state_get_size(ctx));
   }
 
@@ -270,10 +378,12 @@ public:
 
     this->Ref();
 
+    auto queued = std::chrono::steady_clock::now();
     auto worker = new _AsyncWorker(
         Env(),
         [=]()
         {
+          perf.queue(llama_node_elapsed_us(queued));
           auto token_length = tokens.ElementLength();
           size_t n_batch = llama_n_batch(ctx);
 
@@ -288,33 +398,122 @@ public:
           {
             common_batch_add(batch, tokens[i], i + startPos, {0}, logitEnd && i + 1 == token_length);
           }
-          if (llama_decode(ctx, batch) < 0)
+          auto lock = threadpools.lock(token_length);
+          auto start = std::chrono::steady_clock::now();
+          const int32_t result = aborted ? 2 : llama_decode(ctx, batch);
+          llama_batch_free(batch);
+          if (result == 2)
+          {
+            // Drop the ubatches processed before the abort, the sequence ends at startPos again.
+            llama_memory_seq_rm(llama_get_memory(ctx), 0, startPos, -1);
+            throw std::runtime_error("Aborted");
+          }
+          if (result < 0)
           {
             throw std::runtime_error("Eval failed");
           }
 
           llama_synchronize(ctx);
+          lock.unlock();
+          perf.eval(token_length, llama_node_elapsed_us(start));
+        },
+        [=]()
+        {
+          this->updateMemory();
+          this->Unref();
+        });
+
+    worker->Queue(this, priority, true);
+    return worker->Promise();
+  }
+
+  // Decodes one token per entry at its own position and sequence with every output, used to
+  // advance parallel branches by a step in a single batch.
+  Napi::Value EvalBatch(const Napi::CallbackInfo &info)
+  {
+    Napi::Uint32Array _tokens = info[0].As<Napi::Uint32Array>();
+    Napi::Int32Array _positions = info[1].As<Napi::Int32Array>();
+    Napi::Int32Array _seqs = info[2].As<Napi::Int32Array>();
+
+    if (_positions.ElementLength() != _tokens.ElementLength() || _seqs.ElementLength() != _tokens.ElementLength())
+    {
+      Napi::Error::New(Env(), "Invalid batch of arrays of different lengths").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+
+    auto tokens = std::make_shared<std::vector<llama_token>>(_tokens.Data(), _tokens.Data() + _tokens.ElementLength());
+    auto positions = std::make_shared<std::vector<llama_pos>>(_positions.Data(), _positions.Data() + _positions.ElementLength());
+    auto seqs = std::make_shared<std::vector<llama_seq_id>>(_seqs.Data(), _seqs.Data() + _seqs.ElementLength());
+
+    this->Ref();
+
+    auto queued = std::chrono::steady_clock::now();
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          perf.queue(llama_node_elapsed_us(queued));
+          auto token_length = tokens->size();
+
+          if (token_length > llama_n_batch(ctx))
+          {
+            throw std::runtime_error("error: number of tokens exceeds batch size");
+          }
+
+          llama_batch batch = llama_batch_init(token_length, 0, 1);
+
+          for (size_t i = 0; i < token_length; ++i)
+          {
+            common_batch_add(batch, (*tokens)[i], (*positions)[i], {(*seqs)[i]}, true);
+          }
+          auto lock = threadpools.lock(token_length);
+          auto start = std::chrono::steady_clock::now();
+          const int32_t result = aborted ? 2 : llama_decode(ctx, batch);
           llama_batch_free(batch);
+          if (result == 1 || result == 2)
+          {
+            auto mem = llama_get_memory(ctx);
+            for (size_t i = 0; i < token_length; ++i)
+            {
+              llama_memory_seq_rm(mem, (*seqs)[i], (*positions)[i], -1);
+            }
+            throw std::runtime_error(result == 1 ? "Context is full" : "Aborted");
+          }
+          if (result < 0)
+          {
+            throw std::runtime_error("Eval failed");
+          }
+
+          llama_synchronize(ctx);
+          lock.unlock();
+          perf.decode(token_length, llama_node_elapsed_us(start));
         },
         [=]()
         {
+          this->updateMemory();
           this->Unref();
         });
 
-    worker->Queue();
+    worker->Queue(this, priority, true);
     return worker->Promise();
   }
 
   Napi::Value SampleToken(const Napi::CallbackInfo &info)
   {
     auto sampler = Napi::ObjectWrap<LlamaContextSampler>::Unwrap(info[0].As<Napi::Object>());
+    const int32_t idx = info.Length() > 1 ? info[1].As<Napi::Number>().Int32Value() : -1;
     this->Ref();
 
+    auto queued = std::chrono::steady_clock::now();
     auto worker = new _AsyncWorkerWithResult<llama_token>(
         Env(),
         [=]()
         {
-          return llama_sampler_sample(sampler->sampler, ctx, -1);
+          perf.queue(llama_node_elapsed_us(queued));
+          auto start = std::chrono::steady_clock::now();
+          auto token = sampler->grammar.sampler != NULL ? sampler->grammar.sample(sampler->sampler, ctx, idx) : llama_sampler_sample(sampler->sampler, ctx, idx);
+          perf.sample(llama_node_elapsed_us(start));
+          return token;
         },
         [=](Napi::Env env, llama_token result)
         {
@@ -325,27 +524,401 @@ public:
           this->Unref();
         });
 
-    worker->Queue();
+    worker->Queue(this, priority);
     return worker->Promise();
   }
 
   Napi::Value RemoveTokens(const Napi::CallbackInfo &info)
   {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    int32_t startPos = info[0].As<Napi::Number>().Int32Value();
+    int32_t endPos = info[1].As<Napi::Number>().Int32Value();
+    llama_seq_id seq = info.Length() > 2 ? info[2].As<Napi::Number>().Int32Value() : 0;
+
+    bool result = llama_memory_seq_rm(llama_get_memory(ctx), seq, startPos, endPos);
+    updateMemory();
+
+    return Napi::Boolean::New(Env(), result);
+  }
+  // Removes [startPos, endPos) and moves the following positions down over the gap, so the
+  // retained tokens keep their cache and the sequence stays contiguous.
+  Napi::Value DropRange(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
     int32_t startPos = info[0].As<Napi::Number>().Int32Value();
     int32_t endPos = info[1].As<Napi::Number>().Int32Value();
+    llama_seq_id seq = info.Length() > 2 ? info[2].As<Napi::Number>().Int32Value() : 0;
 
-    bool result = llama_memory_seq_rm(llama_get_memory(ctx), 0, startPos, endPos);
+    auto mem = llama_get_memory(ctx);
+    if (endPos >= 0 && !llama_memory_can_shift(mem))
+    {
+      return Napi::Boolean::New(Env(), false);
+    }
+    bool result = llama_memory_seq_rm(mem, seq, startPos, endPos);
+    if (result && endPos >= 0 && endPos > startPos)
+    {
+      llama_memory_seq_add(mem, seq, endPos, -1, startPos - endPos);
+    }
+    updateMemory();
 
     return Napi::Boolean::New(Env(), result);
   }
+  // Moves the sequence back to position zero when its leading positions have been removed.
+  Napi::Value Compact(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    llama_seq_id seq = info.Length() > 0 ? info[0].As<Napi::Number>().Int32Value() : 0;
+
+    auto mem = llama_get_memory(ctx);
+    const llama_pos pos_min = llama_memory_seq_pos_min(mem, seq);
+    if (pos_min <= 0)
+    {
+      return Napi::Boolean::New(Env(), true);
+    }
+    if (!llama_memory_can_shift(mem))
+    {
+      return Napi::Boolean::New(Env(), false);
+    }
+    llama_memory_seq_add(mem, seq, pos_min, -1, -pos_min);
+    updateMemory();
+    return Napi::Boolean::New(Env(), true);
+  }
   Napi::Value ShiftTokens(const Napi::CallbackInfo &info)
   {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
     int32_t startPos = info[0].As<Napi::Number>().Int32Value();
     int32_t endPos = info[1].As<Napi::Number>().Int32Value();
     int32_t shiftDelta = info[2].As<Napi::Number>().Int32Value();
+    llama_seq_id seq = info.Length() > 3 ? info[3].As<Napi::Number>().Int32Value() : 0;
+
+    llama_memory_seq_add(llama_get_memory(ctx), seq, startPos, endPos, shiftDelta);
+    updateMemory();
 
-    llama_memory_seq_add(llama_get_memory(ctx), 0, startPos, endPos, shiftDelta);
+    return Env().Undefined();
+  }
+  // Shares the cells of [startPos, endPos) of one sequence with another, without copying the KV data.
+  Napi::Value CopySequence(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    llama_seq_id src = info[0].As<Napi::Number>().Int32Value();
+    llama_seq_id dst = info[1].As<Napi::Number>().Int32Value();
+    int32_t startPos = info[2].As<Napi::Number>().Int32Value();
+    int32_t endPos = info[3].As<Napi::Number>().Int32Value();
+
+    if ((uint32_t)std::max(src, dst) >= llama_n_seq_max(ctx))
+    {
+      Napi::RangeError::New(Env(), "Sequence out of range").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    llama_memory_seq_cp(llama_get_memory(ctx), src, dst, startPos, endPos);
+    return Env().Undefined();
+  }
+  Napi::Value GetSequences(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    return Napi::Number::From(Env(), llama_n_seq_max(ctx));
+  }
+  Napi::Value MemoryUsage(const Napi::CallbackInfo &info)
+  {
+    updateMemory();
+    return getNapiMemoryUsage(Env(), memory.reported);
+  }
 
+  Napi::Value Perf(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    return getNapiPerf(Env(), ctx, perf);
+  }
+
+  Napi::Value ResetPerf(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+    perf.reset();
+    llama_perf_context_reset(ctx);
+    return Env().Undefined();
+  }
+
+  Napi::Value applyAdapters(const std::vector<LlamaAdapter *> &removed)
+  {
+    this->Ref();
+
+    const auto scales = adapters.scales;
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          llama_node_adapters::apply(ctx, scales);
+        },
+        [=]()
+        {
+          llama_node_adapters::release(removed);
+          this->Unref();
+        });
+
+    worker->Queue(this, priority);
+    return worker->Promise();
+  }
+
+  Napi::Value SetAdapter(const Napi::CallbackInfo &info)
+  {
+    auto adapter = Napi::ObjectWrap<LlamaAdapter>::Unwrap(info[0].As<Napi::Object>());
+    float scale = info[1].As<Napi::Number>().FloatValue();
+    if (adapter->adapter == NULL)
+    {
+      Napi::Error::New(Env(), "Adapter is not loaded").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (adapter->model != model)
+    {
+      Napi::Error::New(Env(), "Adapter belongs to another model").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    adapters.set(adapter, scale);
+    return applyAdapters(std::vector<LlamaAdapter *>());
+  }
+
+  Napi::Value RemoveAdapter(const Napi::CallbackInfo &info)
+  {
+    auto adapter = Napi::ObjectWrap<LlamaAdapter>::Unwrap(info[0].As<Napi::Object>());
+    return applyAdapters(adapters.remove(adapter));
+  }
+
+  Napi::Value ClearAdapters(const Napi::CallbackInfo &info)
+  {
+    return applyAdapters(adapters.clear());
+  }
+
+  // The KV cache can't be resized in place, so every sequence is moved into a new context of
+  // the requested size, keeping its threadpools, adapters and abort flag.
+  // The context is replaced on the executor, where tasks of this context run in order. Until the
+  // worker has completed, methods which read the context on the JS thread are refused.
+  Napi::Value Resize(const Napi::CallbackInfo &info)
+  {
+    if (throwIfResizing())
+    {
+      return Env().Undefined();
+    }
+
+    auto next_params = params;
+    next_params.n_ctx = info[0].As<Napi::Number>().Uint32Value();
+
+    size_t next_bytes;
+    if (!reservation.prepare(model->model, next_params, next_bytes))
+    {
+      llama_node_throw_budget_exceeded(Env(), next_bytes);
+      return Env().Undefined();
+    }
+
+    this->Ref();
+    resizing = true;
+
+    const auto scales = adapters.scales;
+    auto resized = std::make_shared<bool>(false);
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          std::vector<std::pair<llama_seq_id, std::vector<uint8_t>>> states;
+          auto mem = llama_get_memory(ctx);
+          for (llama_seq_id seq = 0; seq < (llama_seq_id)llama_n_seq_max(ctx); ++seq)
+          {
+            if (llama_memory_seq_pos_max(mem, seq) < 0)
+            {
+              continue;
+            }
+            std::vector<uint8_t> state(llama_state_seq_get_size(ctx, seq));
+            if (llama_state_seq_get_data(ctx, state.data(), state.size(), seq) != state.size())
+            {
+              throw std::runtime_error("Failed to copy sequence");
+            }
+            states.emplace_back(seq, std::move(state));
+          }
+          llama_context *next_ctx = llama_init_from_model(model->model, next_params);
+          if (next_ctx == NULL)
+          {
+            throw std::runtime_error("Failed to resize context");
+          }
+          threadpools.attach(next_ctx);
+          llama_set_abort_callback(next_ctx, abortCallback, this);
+          try
+          {
+            llama_node_adapters::apply(next_ctx, scales);
+          }
+          catch (...)
+          {
+            llama_free(next_ctx);
+            throw;
+          }
+          for (const auto &state : states)
+          {
+            if (llama_state_seq_set_data(next_ctx, state.second.data(), state.second.size(), state.first) == 0)
+            {
+              llama_free(next_ctx);
+              throw std::runtime_error("Failed to restore sequence");
+            }
+          }
+          llama_free(ctx);
+          ctx = next_ctx;
+          params = next_params;
+          *resized = true;
+        },
+        [=]()
+        {
+          if (*resized)
+          {
+            reservation.commit(next_bytes);
+            n_ctx = llama_n_ctx(ctx);
+          }
+          else
+          {
+            reservation.rollback();
+          }
+          resizing = false;
+          this->updateMemory();
+          this->Unref();
+        });
+
+    worker->Queue(this, priority, true);
+    return worker->Promise();
+  }
+
+  // Copies sequence 0 out of the KV cache, into a buffer or into a session file along with its tokens.
+  Napi::Value SaveSequence(const Napi::CallbackInfo &info)
+  {
+    Napi::Uint32Array _tokens = info[0].As<Napi::Uint32Array>();
+    auto tokens = std::make_shared<std::vector<llama_token>>(_tokens.Data(), _tokens.Data() + _tokens.ElementLength());
+    const std::string path = info.Length() > 1 && info[1].IsString() ? info[1].As<Napi::String>().Utf8Value() : "";
+
+    this->Ref();
+
+    auto worker = new _AsyncWorkerWithResult<std::shared_ptr<std::vector<uint8_t>>>(
+        Env(),
+        [=]()
+        {
+          if (!path.empty())
+          {
+            if (llama_state_seq_save_file(ctx, path.c_str(), 0, tokens->data(), tokens->size()) == 0)
+            {
+              throw std::runtime_error("Failed to save sequence to " + path);
+            }
+            return std::shared_ptr<std::vector<uint8_t>>();
+          }
+          auto state = std::make_shared<std::vector<uint8_t>>(llama_state_seq_get_size(ctx, 0));
+          if (llama_state_seq_get_data(ctx, state->data(), state->size(), 0) != state->size())
+          {
+            throw std::runtime_error("Failed to copy sequence");
+          }
+          return state;
+        },
+        [=](Napi::Env env, std::shared_ptr<std::vector<uint8_t>> result) -> napi_value
+        {
+          if (!result)
+          {
+            return env.Undefined();
+          }
+          auto data = new std::vector<uint8_t>(std::move(*result));
+          Napi::MemoryManagement::AdjustExternalMemory(env, data->size());
+          Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(
+              env, data->data(), data->size(),
+              [](Napi::Env env, void *, std::vector<uint8_t> *data)
+              {
+                Napi::MemoryManagement::AdjustExternalMemory(env, -(int64_t)data->size());
+                delete data;
+              },
+              data);
+          return Napi::Uint8Array::New(env, data->size(), buffer, 0);
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this, priority);
+    return worker->Promise();
+  }
+
+  // Replaces the KV cache with a sequence saved by saveSequence, from a buffer or a session file.
+  Napi::Value LoadSequence(const Napi::CallbackInfo &info)
+  {
+    const bool from_file = info[0].IsString();
+    const std::string path = from_file ? info[0].As<Napi::String>().Utf8Value() : "";
+    auto state = std::make_shared<std::vector<uint8_t>>();
+    if (!from_file)
+    {
+      Napi::Uint8Array _state = info[0].As<Napi::Uint8Array>();
+      state->assign(_state.Data(), _state.Data() + _state.ElementLength());
+    }
+    const size_t n_tokens = info[1].As<Napi::Number>().Uint32Value();
+
+    this->Ref();
+
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          auto mem = llama_get_memory(ctx);
+          llama_memory_clear(mem, true);
+          size_t result;
+          if (from_file)
+          {
+            std::vector<llama_token> tokens(n_tokens);
+            size_t n_loaded = 0;
+            result = llama_state_seq_load_file(ctx, path.c_str(), 0, tokens.data(), tokens.size(), &n_loaded);
+            result = n_loaded == n_tokens ? result : 0;
+          }
+          else
+          {
+            result = llama_state_seq_set_data(ctx, state->data(), state->size(), 0);
+          }
+          if (result == 0)
+          {
+            llama_memory_clear(mem, true);
+            throw std::runtime_error("Failed to load sequence");
+          }
+        },
+        [=]()
+        {
+          this->updateMemory();
+          this->Unref();
+        });
+
+    worker->Queue(this, priority, true);
+    return worker->Promise();
+  }
+
+  Napi::Value Abort(const Napi::CallbackInfo &info)
+  {
+    aborted = true;
+    return Env().Undefined();
+  }
+
+  Napi::Value ResetAbort(const Napi::CallbackInfo &info)
+  {
+    aborted = false;
     return Env().Undefined();
   }
   static void init(Napi::Object exports)
@@ -357,10 +930,26 @@ public:
             InstanceMethod("contextSize", &LlamaContext::GetContextSize),
             InstanceMethod("batchSize", &LlamaContext::GetBatchSize),
             InstanceMethod("stateSize", &LlamaContext::GetStateSize),
+            InstanceMethod("sequences", &LlamaContext::GetSequences),
             InstanceMethod("eval", &LlamaContext::EvalSequence),
+            InstanceMethod("evalBatch", &LlamaContext::EvalBatch),
             InstanceMethod("sampleToken", &LlamaContext::SampleToken),
             InstanceMethod("removeTokens", &LlamaContext::RemoveTokens),
             InstanceMethod("shiftTokens", &LlamaContext::ShiftTokens),
+            InstanceMethod("copySequence", &LlamaContext::CopySequence),
+            InstanceMethod("dropRange", &LlamaContext::DropRange),
+            InstanceMethod("compact", &LlamaContext::Compact),
+            InstanceMethod("memoryUsage", &LlamaContext::MemoryUsage),
+            InstanceMethod("perf", &LlamaContext::Perf),
+            InstanceMethod("resetPerf", &LlamaContext::ResetPerf),
+            InstanceMethod("setAdapter", &LlamaContext::SetAdapter),
+            InstanceMethod("removeAdapter", &LlamaContext::RemoveAdapter),
+            InstanceMethod("clearAdapters", &LlamaContext::ClearAdapters),
+            InstanceMethod("resize", &LlamaContext::Resize),
+            InstanceMethod("saveSequence", &LlamaContext::SaveSequence),
+            InstanceMethod("loadSequence", &LlamaContext::LoadSequence),
+            InstanceMethod("abort", &LlamaContext::Abort),
+            InstanceMethod("resetAbort", &LlamaContext::ResetAbort),
             InstanceMethod("dispose", &LlamaContext::Dispose),
         });
     exports.Set("LlamaContext", def);
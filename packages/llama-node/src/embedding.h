@@ -25,21 +25,98 @@
 
 #pragma once
 
+#include <cmath>
+
 #include "common.h"
 #include "model.h"
 #include "worker.h"
+#include "perf.h"
+#include "threadpool.h"
+#include "budget.h"
+
+struct llama_node_embedding_format
+{
+  int embd_norm = -1;
+  int dimensions = 0;
+  std::string type = "float32";
+
+  llama_node_embedding_format(Napi::Object options)
+  {
+    if (options.Has("normalize"))
+    {
+      embd_norm = options.Get("normalize").As<Napi::Number>().Int32Value();
+    }
+    if (options.Has("dimensions"))
+    {
+      dimensions = options.Get("dimensions").As<Napi::Number>().Int32Value();
+    }
+    if (options.Has("format"))
+    {
+      type = options.Get("format").As<Napi::String>().Utf8Value();
+    }
+  }
+
+  bool valid() const
+  {
+    return type == "float32" || type == "float16" || type == "int8";
+  }
+};
+
+// Truncates an embedding to the leading dimensions (Matryoshka models), normalizes what is kept and
+// converts it to the output format in one pass. int8 output is symmetric with a per vector scale.
+static Napi::Value getNapiEmbedding(Napi::Env env, const float *embd, int n_embd, const llama_node_embedding_format &format)
+{
+  const int n = format.dimensions > 0 ? std::min(format.dimensions, n_embd) : n_embd;
+
+  if (format.type == "float32")
+  {
+    Napi::Float32Array result = Napi::Float32Array::New(env, n);
+    common_embd_normalize(embd, result.Data(), n, format.embd_norm);
+    return result;
+  }
+
+  std::vector<float> normalized(n);
+  common_embd_normalize(embd, normalized.data(), n, format.embd_norm);
+
+  if (format.type == "float16")
+  {
+    Napi::Uint16Array result = Napi::Uint16Array::New(env, n);
+    ggml_fp32_to_fp16_row(normalized.data(), result.Data(), n);
+    return result;
+  }
+
+  float max = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    max = std::max(max, std::fabs(normalized[i]));
+  }
+  const float scale = max > 0 ? max / 127.0f : 1.0f;
+  Napi::Int8Array data = Napi::Int8Array::New(env, n);
+  for (int i = 0; i < n; ++i)
+  {
+    data[i] = (int8_t)std::round(normalized[i] / scale);
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("data", data);
+  result.Set("scale", Napi::Number::New(env, scale));
+  return result;
+}
 
 class LlamaEmbeddingContext : public Napi::ObjectWrap<LlamaEmbeddingContext>
 {
 public:
   LlamaModel *model;
   llama_context_params params;
-  llama_context *ctx;
+  llama_context *ctx = NULL;
+  ExternalMemory memory;
+  llama_node_perf_counters perf;
+  llama_node_threadpools threadpools;
+  llama_node_kv_reservation reservation;
+  int32_t priority = 0;
 
   LlamaEmbeddingContext(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaEmbeddingContext>(info)
   {
     model = Napi::ObjectWrap<LlamaModel>::Unwrap(info[0].As<Napi::Object>());
-    model->Ref();
 
     auto hardware_concurrency = std::thread::hardware_concurrency();
 
@@ -48,6 +125,7 @@ public:
     params.n_seq_max = 1;
     params.n_threads = hardware_concurrency;
     params.n_threads_batch = hardware_concurrency;
+    params.no_perf = false;
     params.embeddings = true;
 
     Napi::Object options = info[1].As<Napi::Object>();
@@ -64,19 +142,44 @@ public:
       params.n_threads_batch = resolved_n_threads;
     }
 
+    if (options.Has("sequences"))
+    {
+      params.n_seq_max = std::max(1u, options.Get("sequences").As<Napi::Number>().Uint32Value());
+      params.kv_unified = true;
+    }
+
     if (options.Has("poolingType"))
     {
       const auto pooling_type = options.Get("poolingType").As<Napi::Number>().Uint32Value();
       params.pooling_type = static_cast<enum llama_pooling_type>(pooling_type);
     }
 
+    if (options.Has("priority"))
+    {
+      priority = options.Get("priority").As<Napi::Number>().Int32Value();
+    }
+
+    if (!reservation.reserve(model->model, params))
+    {
+      llama_node_throw_budget_exceeded(Env(), reservation.bytes);
+      return;
+    }
+
+    threadpools.init(options, params);
+
     ctx = llama_init_from_model(model->model, params);
     if (ctx == NULL)
     {
+      reservation.release();
+      threadpools.release();
       Napi::Error::New(Env(), "Failed to load context").ThrowAsJavaScriptException();
+      return;
     }
+    // only a created context is disposed, which releases the model
+    model->Ref();
+    threadpools.attach(ctx);
 
-    Napi::MemoryManagement::AdjustExternalMemory(Env(), llama_state_get_size(ctx));
+    updateMemory();
   }
 
   ~LlamaEmbeddingContext()
@@ -90,12 +193,19 @@ public:
     {
       return;
     }
-    Napi::MemoryManagement::AdjustExternalMemory(Env(), -(int64_t)llama_state_get_size(ctx));
+    memory.release(Env());
     llama_free(ctx);
     ctx = NULL;
+    threadpools.release();
+    reservation.release();
     model->Unref();
   }
 
+  void updateMemory()
+  {
+    memory.update(Env(), llama_node_context_memory_usage(ctx, model->params, params));
+  }
+
   Napi::Value Dispose(const Napi::CallbackInfo &info)
   {
     if (ctx != NULL)
@@ -110,13 +220,16 @@ public:
     Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
     int32_t startPos = info[1].As<Napi::Number>().Int32Value();
     bool logitEnd = info[2].As<Napi::Boolean>().Value();
+    bool outputAll = info.Length() > 3 && info[3].As<Napi::Boolean>().Value();
 
     this->Ref();
 
+    auto queued = std::chrono::steady_clock::now();
     auto worker = new _AsyncWorker(
         Env(),
         [=]()
         {
+          perf.queue(llama_node_elapsed_us(queued));
           auto token_length = tokens.ElementLength();
           size_t n_batch = llama_n_batch(ctx);
 
@@ -129,32 +242,129 @@ public:
 
           for (size_t i = 0; i < token_length; ++i)
           {
-            common_batch_add(batch, tokens[i], i + startPos, {0}, logitEnd && i + 1 == token_length);
+            common_batch_add(batch, tokens[i], i + startPos, {0}, outputAll || (logitEnd && i + 1 == token_length));
           }
+          auto lock = threadpools.lock(token_length);
+          auto start = std::chrono::steady_clock::now();
           if (llama_decode(ctx, batch) < 0)
           {
             throw std::runtime_error("Eval failed");
           }
 
           llama_synchronize(ctx);
+          lock.unlock();
+          perf.eval(token_length, llama_node_elapsed_us(start));
           llama_batch_free(batch);
         },
         [=]()
         {
+          this->updateMemory();
           this->Unref();
         });
 
-    worker->Queue();
+    worker->Queue(this, priority, true);
     return worker->Promise();
   }
-  Napi::Value GetEmbedding(const Napi::CallbackInfo &info)
+  // Evaluates each token array as its own sequence in a single batch, replacing whatever the context held.
+  Napi::Value EvalSequences(const Napi::CallbackInfo &info)
   {
-    int embd_norm = -1;
+    Napi::Array list = info[0].As<Napi::Array>();
 
-    Napi::Object options = info[0].As<Napi::Object>();
-    if (options.Has("normalize"))
+    std::vector<std::vector<llama_token>> sequences;
+    size_t token_length = 0;
+    for (uint32_t i = 0; i < list.Length(); ++i)
     {
-      embd_norm = options.Get("normalize").As<Napi::Number>().Int32Value();
+      Napi::Uint32Array tokens = list.Get(i).As<Napi::Uint32Array>();
+      sequences.push_back(std::vector<llama_token>(tokens.Data(), tokens.Data() + tokens.ElementLength()));
+      token_length += tokens.ElementLength();
+    }
+
+    if (sequences.size() > llama_n_seq_max(ctx))
+    {
+      Napi::Error::New(Env(), "Number of sequences exceeds context sequences").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (token_length > llama_n_batch(ctx))
+    {
+      Napi::Error::New(Env(), "Number of tokens exceeds batch size").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+
+    this->Ref();
+
+    auto queued = std::chrono::steady_clock::now();
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          perf.queue(llama_node_elapsed_us(queued));
+          llama_memory_clear(llama_get_memory(ctx), true);
+
+          llama_batch batch = llama_batch_init(token_length, 0, sequences.size());
+          for (size_t seq = 0; seq < sequences.size(); ++seq)
+          {
+            for (size_t i = 0; i < sequences[seq].size(); ++i)
+            {
+              common_batch_add(batch, sequences[seq][i], i, {(llama_seq_id)seq}, true);
+            }
+          }
+
+          auto lock = threadpools.lock(token_length);
+          auto start = std::chrono::steady_clock::now();
+          const int32_t result = llama_decode(ctx, batch);
+          llama_batch_free(batch);
+          if (result < 0)
+          {
+            throw std::runtime_error("Eval failed");
+          }
+
+          llama_synchronize(ctx);
+          lock.unlock();
+          perf.eval(token_length, llama_node_elapsed_us(start));
+        },
+        [=]()
+        {
+          this->updateMemory();
+          this->Unref();
+        });
+
+    worker->Queue(this, priority, true);
+    return worker->Promise();
+  }
+
+  Napi::Value GetEmbeddings(const Napi::CallbackInfo &info)
+  {
+    const uint32_t n_seq = info[0].As<Napi::Number>().Uint32Value();
+
+    llama_node_embedding_format format(info[1].As<Napi::Object>());
+    if (!format.valid())
+    {
+      Napi::Error::New(Env(), "Unknown embedding format " + format.type).ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+
+    const int n_embd = llama_model_n_embd(model->model);
+    Napi::Array result = Napi::Array::New(Env(), n_seq);
+    for (uint32_t seq = 0; seq < n_seq; ++seq)
+    {
+      auto *embeddings = llama_get_embeddings_seq(ctx, seq);
+      if (embeddings == NULL)
+      {
+        Napi::Error::New(Env(), "Failed to get embeddings").ThrowAsJavaScriptException();
+        return Env().Undefined();
+      }
+      result[seq] = getNapiEmbedding(Env(), embeddings, n_embd, format);
+    }
+    return result;
+  }
+
+  Napi::Value GetEmbedding(const Napi::CallbackInfo &info)
+  {
+    llama_node_embedding_format format(info[0].As<Napi::Object>());
+    if (!format.valid())
+    {
+      Napi::Error::New(Env(), "Unknown embedding format " + format.type).ThrowAsJavaScriptException();
+      return Env().Undefined();
     }
 
     const int n_embd = llama_model_n_embd(model->model);
@@ -170,10 +380,66 @@ public:
       }
     }
 
-    Napi::Float32Array result = Napi::Float32Array::New(Env(), n_embd);
-    common_embd_normalize(embeddings, result.Data(), n_embd, embd_norm);
+    return getNapiEmbedding(Env(), embeddings, n_embd, format);
+  }
 
-    return result;
+  // The embeddings of the last `count` evaluated tokens as one [count x n_embd] array, which
+  // is handed to JS without a copy. Requires the tokens to be evaluated with every output.
+  Napi::Value GetTokenEmbeddings(const Napi::CallbackInfo &info)
+  {
+    const uint32_t count = info[0].As<Napi::Number>().Uint32Value();
+
+    int embd_norm = -1;
+    Napi::Object options = info[1].As<Napi::Object>();
+    if (options.Has("normalize"))
+    {
+      embd_norm = options.Get("normalize").As<Napi::Number>().Int32Value();
+    }
+
+    const int n_embd = llama_model_n_embd(model->model);
+    float *data = new float[(size_t)count * n_embd];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      auto *embeddings = llama_get_embeddings_ith(ctx, (int32_t)i - (int32_t)count);
+      if (embeddings == NULL)
+      {
+        delete[] data;
+        Napi::Error::New(Env(), "Failed to get embeddings").ThrowAsJavaScriptException();
+        return Env().Undefined();
+      }
+      common_embd_normalize(embeddings, data + (size_t)i * n_embd, n_embd, embd_norm);
+    }
+
+    const size_t byte_length = (size_t)count * n_embd * sizeof(float);
+    Napi::MemoryManagement::AdjustExternalMemory(Env(), byte_length);
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(
+        Env(), data, byte_length,
+        [](Napi::Env env, void *data, size_t *byte_length)
+        {
+          Napi::MemoryManagement::AdjustExternalMemory(env, -(int64_t)*byte_length);
+          delete[] static_cast<float *>(data);
+          delete byte_length;
+        },
+        new size_t(byte_length));
+    return Napi::Float32Array::New(Env(), (size_t)count * n_embd, buffer, 0);
+  }
+
+  Napi::Value MemoryUsage(const Napi::CallbackInfo &info)
+  {
+    updateMemory();
+    return getNapiMemoryUsage(Env(), memory.reported);
+  }
+
+  Napi::Value Perf(const Napi::CallbackInfo &info)
+  {
+    return getNapiPerf(Env(), ctx, perf);
+  }
+
+  Napi::Value ResetPerf(const Napi::CallbackInfo &info)
+  {
+    perf.reset();
+    llama_perf_context_reset(ctx);
+    return Env().Undefined();
   }
 
   static void init(Napi::Object exports)
@@ -184,6 +450,12 @@ public:
         {
             InstanceMethod("eval", &LlamaEmbeddingContext::EvalEmbedding),
             InstanceMethod("embedding", &LlamaEmbeddingContext::GetEmbedding),
+            InstanceMethod("evalSequences", &LlamaEmbeddingContext::EvalSequences),
+            InstanceMethod("embeddings", &LlamaEmbeddingContext::GetEmbeddings),
+            InstanceMethod("tokenEmbeddings", &LlamaEmbeddingContext::GetTokenEmbeddings),
+            InstanceMethod("memoryUsage", &LlamaEmbeddingContext::MemoryUsage),
+            InstanceMethod("perf", &LlamaEmbeddingContext::Perf),
+            InstanceMethod("resetPerf", &LlamaEmbeddingContext::ResetPerf),
             InstanceMethod("dispose", &LlamaEmbeddingContext::Dispose),
         });
     exports.Set("LlamaEmbeddingContext", def);
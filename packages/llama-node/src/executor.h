@@ -0,0 +1,330 @@
+//
+//  executor.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include "common.h"
+#include "perf.h"
+
+// Completions of the tasks submitted from one env, which are run on that env's JS thread.
+struct llama_node_executor_env
+{
+  std::mutex mutex;
+  Napi::ThreadSafeFunction tsfn;
+  bool closed = false;
+  size_t pending = 0;
+};
+
+class llama_node_task
+{
+public:
+  std::shared_ptr<llama_node_executor_env> target;
+  const void *owner = NULL;
+  int32_t priority = 0;
+  bool decode = false;
+  uint64_t sequence = 0;
+  std::chrono::steady_clock::time_point queued;
+
+  virtual ~llama_node_task() {}
+
+  virtual void Execute() = 0;
+
+  virtual void Complete(Napi::Env env) = 0;
+
+  // Frees what the task holds for Execute when its env has closed. The promise and finalizer
+  // need that env's JS thread, so the task itself is leaked.
+  virtual void Abandon() = 0;
+};
+
+struct llama_node_executor_stats
+{
+  size_t threads = 0;
+  size_t queued = 0;
+  size_t running = 0;
+  size_t decoding = 0;
+  size_t max_decodes = 0;
+  size_t queues = 0;
+  uint64_t completed = 0;
+  int64_t wait_us = 0;
+  int64_t max_wait_us = 0;
+};
+
+// Tasks of the same owner run one at a time in submission order.
+class llama_node_executor
+{
+public:
+  // Never destroyed, the threads are stopped by the cleanup hook of the last env instead of
+  // being joined at exit, where a running decode would hold up the process.
+  static llama_node_executor &shared()
+  {
+    static llama_node_executor *executor = new llama_node_executor();
+    return *executor;
+  }
+
+  // Threads are only ever added, a smaller count than the current one is ignored.
+  void resize(size_t n_threads)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    spawn(n_threads);
+  }
+
+  void submit(Napi::Env env, llama_node_task *task)
+  {
+    task->target = attach(env);
+    if (task->target->pending++ == 0)
+    {
+      task->target->tsfn.Ref(env);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (n_threads == 0)
+      {
+        spawn(std::max<size_t>(1, std::min<size_t>(4, std::thread::hardware_concurrency())));
+      }
+      task->sequence = sequence++;
+      task->queued = std::chrono::steady_clock::now();
+      if (task->owner == NULL)
+      {
+        task->owner = task;
+      }
+      queues[task->owner].push_back(task);
+      stats.queued++;
+    }
+    condition.notify_one();
+  }
+
+  llama_node_executor_stats getStats()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    llama_node_executor_stats result = stats;
+    result.threads = n_threads;
+    result.queues = queues.size();
+    return result;
+  }
+
+  // Zero means unlimited.
+  void setMaxDecodes(size_t max_decodes)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.max_decodes = max_decodes;
+    }
+    condition.notify_all();
+  }
+
+  void resetStats()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.completed = 0;
+    stats.wait_us = 0;
+    stats.max_wait_us = 0;
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t n_threads = 0;
+  // threads of an older generation exit once their current task is done
+  uint64_t generation = 0;
+  std::map<const void *, std::deque<llama_node_task *>> queues;
+  std::set<const void *> running;
+  llama_node_executor_stats stats;
+  uint64_t sequence = 0;
+
+  std::map<napi_env, std::shared_ptr<llama_node_executor_env>> envs;
+
+  std::shared_ptr<llama_node_executor_env> attach(Napi::Env env)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &target = envs[env];
+    if (target == NULL)
+    {
+      target = std::make_shared<llama_node_executor_env>();
+      target->tsfn = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo &) {}), "llama-node-executor", 0, 1);
+      target->tsfn.Unref(env);
+      napi_add_env_cleanup_hook(env, detach, (napi_env)env);
+    }
+    return target;
+  }
+
+  static void detach(void *arg)
+  {
+    auto &executor = llama_node_executor::shared();
+    std::shared_ptr<llama_node_executor_env> target;
+    {
+      std::lock_guard<std::mutex> lock(executor.mutex);
+      auto it = executor.envs.find((napi_env)arg);
+      if (it == executor.envs.end())
+      {
+        return;
+      }
+      target = it->second;
+      executor.envs.erase(it);
+      if (executor.envs.empty())
+      {
+        executor.generation++;
+        executor.n_threads = 0;
+      }
+    }
+    executor.condition.notify_all();
+    std::lock_guard<std::mutex> lock(target->mutex);
+    target->closed = true;
+    target->tsfn.Release();
+  }
+
+  void spawn(size_t count)
+  {
+    while (n_threads < count)
+    {
+      std::thread(&llama_node_executor::run, this, generation).detach();
+      n_threads++;
+    }
+  }
+
+  llama_node_task *next()
+  {
+    llama_node_task *selected = NULL;
+    for (auto &queue : queues)
+    {
+      if (running.count(queue.first) != 0)
+      {
+        continue;
+      }
+      auto task = queue.second.front();
+      if (task->decode && stats.max_decodes > 0 && stats.decoding >= stats.max_decodes)
+      {
+        continue;
+      }
+      if (selected == NULL || task->priority > selected->priority || (task->priority == selected->priority && task->sequence < selected->sequence))
+      {
+        selected = task;
+      }
+    }
+    return selected;
+  }
+
+  void run(uint64_t _generation)
+  {
+    while (true)
+    {
+      llama_node_task *task = NULL;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (generation == _generation && (task = next()) == NULL)
+        {
+          condition.wait(lock);
+        }
+        if (generation != _generation)
+        {
+          return;
+        }
+        auto queue = queues.find(task->owner);
+        queue->second.pop_front();
+        if (queue->second.empty())
+        {
+          queues.erase(queue);
+        }
+        running.insert(task->owner);
+        stats.queued--;
+        stats.running++;
+        stats.decoding += task->decode ? 1 : 0;
+      }
+
+      const int64_t wait_us = llama_node_elapsed_us(task->queued);
+      task->Execute();
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        running.erase(task->owner);
+        stats.running--;
+        stats.decoding -= task->decode ? 1 : 0;
+        stats.completed++;
+        stats.wait_us += wait_us;
+        stats.max_wait_us = std::max(stats.max_wait_us, wait_us);
+      }
+      condition.notify_all();
+
+      std::lock_guard<std::mutex> lock(task->target->mutex);
+      if (task->target->closed)
+      {
+        task->Abandon();
+      }
+      else
+      {
+        task->target->tsfn.BlockingCall(task, [](Napi::Env env, Napi::Function, llama_node_task *task)
+                                        { complete(env, task); });
+      }
+    }
+  }
+
+  static void complete(Napi::Env env, llama_node_task *task)
+  {
+    if ((napi_env)env == NULL)
+    {
+      return;
+    }
+    auto target = task->target;
+    task->Complete(env);
+    delete task;
+    if (--target->pending == 0)
+    {
+      target->tsfn.Unref(env);
+    }
+  }
+};
+
+Napi::Value getExecutorStats(const Napi::CallbackInfo &info)
+{
+  const auto stats = llama_node_executor::shared().getStats();
+  Napi::Object result = Napi::Object::New(info.Env());
+  result.Set("threads", Napi::Number::From(info.Env(), stats.threads));
+  result.Set("queued", Napi::Number::From(info.Env(), stats.queued));
+  result.Set("running", Napi::Number::From(info.Env(), stats.running));
+  result.Set("decoding", Napi::Number::From(info.Env(), stats.decoding));
+  result.Set("queues", Napi::Number::From(info.Env(), stats.queues));
+  result.Set("completed", Napi::Number::From(info.Env(), stats.completed));
+  result.Set("averageWaitTime", Napi::Number::From(info.Env(), stats.completed > 0 ? stats.wait_us / 1000.0 / stats.completed : 0));
+  result.Set("maxWaitTime", Napi::Number::From(info.Env(), stats.max_wait_us / 1000.0));
+  return result;
+}
+
+Napi::Value resetExecutorStats(const Napi::CallbackInfo &info)
+{
+  llama_node_executor::shared().resetStats();
+  return info.Env().Undefined();
+}
+
+Napi::Value setExecutorThreads(const Napi::CallbackInfo &info)
+{
+  llama_node_executor::shared().resize(info[0].As<Napi::Number>().Uint32Value());
+  return info.Env().Undefined();
+}
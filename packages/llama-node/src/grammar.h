@@ -0,0 +1,236 @@
+//
+//  grammar.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "common.h"
+#include "hash.h"
+
+static inline uint64_t llama_node_grammar_mix(uint64_t state, uint64_t value)
+{
+  // splitmix64 finalizer over the running state
+  uint64_t z = state + value + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Tokens a grammar allows in one state, as a bitset over the vocab.
+typedef std::vector<uint64_t> llama_node_grammar_mask;
+
+// Masks shared by every sampler of the process, keyed by the model identity, the grammar and
+// every token accepted since it started. Only generations which repeat an accepted prefix hit,
+// such as the fixed keys and punctuation which open a schema constrained object.
+class llama_node_grammar_masks
+{
+public:
+  static llama_node_grammar_masks &shared()
+  {
+    static llama_node_grammar_masks masks;
+    return masks;
+  }
+
+  std::shared_ptr<const llama_node_grammar_mask> get(uint64_t key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end())
+    {
+      return NULL;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+  }
+
+  void set(uint64_t key, std::shared_ptr<const llama_node_grammar_mask> mask)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.count(key) > 0)
+    {
+      return;
+    }
+    entries.emplace_front(key, mask);
+    index[key] = entries.begin();
+    bytes += mask->size() * sizeof(uint64_t);
+    while (bytes > max_bytes && entries.size() > 1)
+    {
+      auto &last = entries.back();
+      bytes -= last.second->size() * sizeof(uint64_t);
+      index.erase(last.first);
+      entries.pop_back();
+    }
+  }
+
+private:
+  typedef std::pair<uint64_t, std::shared_ptr<const llama_node_grammar_mask>> entry;
+
+  std::mutex mutex;
+  std::list<entry> entries;
+  std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+  size_t bytes = 0;
+  size_t max_bytes = 64 * 1024 * 1024;
+};
+
+// Samples with a grammar without running it over the whole vocab on most steps: the token picked
+// by the rest of the chain is checked alone first, and the full vocab is only filtered when the
+// grammar rejects it. A filtered state is kept as a mask, applied to the logits as a bitset next time.
+struct llama_node_grammar
+{
+  llama_sampler *sampler = NULL;
+  uint64_t key = 0;
+  std::vector<llama_token_data> candidates;
+  std::vector<llama_token_data> scratch;
+
+  void init(const llama_model *model, const llama_node_hash128 &identity, const std::string &grammar)
+  {
+    sampler = llama_sampler_init_grammar(llama_model_get_vocab(model), grammar.c_str(), "root");
+    key = llama_node_grammar_mix(llama_node_grammar_mix(0, identity.h1), identity.h2);
+    for (char c : grammar)
+    {
+      key = llama_node_grammar_mix(key, (unsigned char)c);
+    }
+  }
+
+  void release()
+  {
+    if (sampler == NULL)
+    {
+      return;
+    }
+    llama_sampler_free(sampler);
+    sampler = NULL;
+  }
+
+  void accept(llama_sampler *chain, llama_token token)
+  {
+    llama_sampler_accept(sampler, token);
+    llama_sampler_accept(chain, token);
+    key = llama_node_grammar_mix(key, (uint32_t)token);
+  }
+
+  bool allows(llama_token token)
+  {
+    llama_token_data single = {token, 1.0f, 0.0f};
+    llama_token_data_array single_p = {&single, 1, -1, false};
+    llama_sampler_apply(sampler, &single_p);
+    return !std::isinf(single.logit);
+  }
+
+  llama_token sample(llama_sampler *chain, llama_context *ctx, int32_t idx)
+  {
+    const float *logits = llama_get_logits_ith(ctx, idx);
+    const int32_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+
+    auto load = [&]()
+    {
+      candidates.resize(n_vocab);
+      for (int32_t i = 0; i < n_vocab; ++i)
+      {
+        candidates[i] = llama_token_data{i, logits[i], 0.0f};
+      }
+    };
+    auto select = [&]()
+    {
+      llama_token_data_array cur_p = {candidates.data(), candidates.size(), -1, false};
+      llama_sampler_apply(chain, &cur_p);
+      if (cur_p.selected < 0 || cur_p.selected >= (int64_t)cur_p.size)
+      {
+        throw std::runtime_error("No token allowed by the grammar");
+      }
+      return cur_p.data[cur_p.selected].id;
+    };
+
+    auto &masks = llama_node_grammar_masks::shared();
+    auto mask = masks.get(key);
+    if (mask && mask->size() != (size_t)(n_vocab + 63) / 64)
+    {
+      mask = NULL;
+    }
+
+    load();
+    llama_token token;
+    if (mask)
+    {
+      apply(*mask);
+      token = select();
+    }
+    else
+    {
+      token = select();
+      if (!allows(token))
+      {
+        auto computed = std::make_shared<llama_node_grammar_mask>(filter(n_vocab));
+        masks.set(key, computed);
+        load();
+        apply(*computed);
+        token = select();
+      }
+    }
+
+    accept(chain, token);
+    return token;
+  }
+
+private:
+  // The grammar over the whole vocab with equal logits, so the mask doesn't depend on this step.
+  llama_node_grammar_mask filter(int32_t n_vocab)
+  {
+    scratch.resize(n_vocab);
+    for (int32_t i = 0; i < n_vocab; ++i)
+    {
+      scratch[i] = llama_token_data{i, 0.0f, 0.0f};
+    }
+    llama_token_data_array scratch_p = {scratch.data(), scratch.size(), -1, false};
+    llama_sampler_apply(sampler, &scratch_p);
+
+    llama_node_grammar_mask mask((n_vocab + 63) / 64, 0);
+    for (size_t i = 0; i < scratch_p.size; ++i)
+    {
+      if (!std::isinf(scratch_p.data[i].logit))
+      {
+        const auto id = scratch_p.data[i].id;
+        mask[id / 64] |= 1ULL << (id % 64);
+      }
+    }
+    return mask;
+  }
+
+  void apply(const llama_node_grammar_mask &mask)
+  {
+    for (auto &candidate : candidates)
+    {
+      const auto id = candidate.id;
+      if ((mask[id / 64] >> (id % 64) & 1) == 0)
+      {
+        candidate.logit = -INFINITY;
+      }
+    }
+  }
+};
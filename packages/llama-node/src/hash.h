@@ -0,0 +1,145 @@
+//
+//  hash.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+struct llama_node_hash128
+{
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+
+  bool operator==(const llama_node_hash128 &other) const
+  {
+    return h1 == other.h1 && h2 == other.h2;
+  }
+};
+
+struct llama_node_hash128_hasher
+{
+  size_t operator()(const llama_node_hash128 &hash) const
+  {
+    return (size_t)(hash.h1 ^ (hash.h2 * 0x9e3779b97f4a7c15ULL));
+  }
+};
+
+static inline uint64_t llama_node_rotl64(uint64_t x, int8_t r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t llama_node_fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3 x64 128, seeded with a previous hash so that several parts can be chained.
+static llama_node_hash128 llama_node_hash(const void *key, size_t len, llama_node_hash128 seed = llama_node_hash128())
+{
+  const uint8_t *data = (const uint8_t *)key;
+  const size_t nblocks = len / 16;
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+  uint64_t h1 = seed.h1;
+  uint64_t h2 = seed.h2;
+
+  for (size_t i = 0; i < nblocks; i++)
+  {
+    uint64_t k1, k2;
+    memcpy(&k1, data + i * 16, 8);
+    memcpy(&k2, data + i * 16 + 8, 8);
+
+    k1 *= c1;
+    k1 = llama_node_rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = llama_node_rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = llama_node_rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    h2 = llama_node_rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const uint8_t *tail = data + nblocks * 16;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  switch (len & 15)
+  {
+  case 15: k2 ^= ((uint64_t)tail[14]) << 48; // fallthrough
+  case 14: k2 ^= ((uint64_t)tail[13]) << 40; // fallthrough
+  case 13: k2 ^= ((uint64_t)tail[12]) << 32; // fallthrough
+  case 12: k2 ^= ((uint64_t)tail[11]) << 24; // fallthrough
+  case 11: k2 ^= ((uint64_t)tail[10]) << 16; // fallthrough
+  case 10: k2 ^= ((uint64_t)tail[9]) << 8;   // fallthrough
+  case 9:
+    k2 ^= ((uint64_t)tail[8]);
+    k2 *= c2;
+    k2 = llama_node_rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    // fallthrough
+  case 8: k1 ^= ((uint64_t)tail[7]) << 56; // fallthrough
+  case 7: k1 ^= ((uint64_t)tail[6]) << 48; // fallthrough
+  case 6: k1 ^= ((uint64_t)tail[5]) << 40; // fallthrough
+  case 5: k1 ^= ((uint64_t)tail[4]) << 32; // fallthrough
+  case 4: k1 ^= ((uint64_t)tail[3]) << 24; // fallthrough
+  case 3: k1 ^= ((uint64_t)tail[2]) << 16; // fallthrough
+  case 2: k1 ^= ((uint64_t)tail[1]) << 8;  // fallthrough
+  case 1:
+    k1 ^= ((uint64_t)tail[0]);
+    k1 *= c1;
+    k1 = llama_node_rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = llama_node_fmix64(h1);
+  h2 = llama_node_fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+
+  llama_node_hash128 result;
+  result.h1 = h1;
+  result.h2 = h2;
+  return result;
+}
@@ -0,0 +1,600 @@
+//
+//  ivfpq.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+#include "common.h"
+#include "worker.h"
+#include "kmeans.h"
+#include "cache.h"
+
+// Inverted file of product quantized residuals. Trained parameters stay in memory, the lists are
+// kept in one file which is mapped, so a search only touches the pages of the lists it probes.
+// Vectors added after the file was written are kept in memory until the next save.
+//
+// File: "LIVF", version, d, nlist, m, n, centroids, codebooks, nlist + 1 list offsets counted in
+// vectors, then for each list its ids followed by its codes.
+class LlamaIVFPQIndex : public Napi::ObjectWrap<LlamaIVFPQIndex>
+{
+public:
+  static const uint32_t ksub = 256;
+
+  std::mutex mutex;
+  uint32_t d = 0;
+  uint32_t nlist = 0;
+  uint32_t m = 0;
+  bool trained = false;
+  std::vector<float> centroids;
+  std::vector<float> codebooks;
+
+  std::string path;
+  llama_node_mapped_file mapped;
+  std::vector<uint64_t> offsets;
+  size_t data_offset = 0;
+  uint64_t n_disk = 0;
+
+  std::vector<std::vector<uint32_t>> staged_ids;
+  std::vector<std::vector<uint8_t>> staged_codes;
+  uint64_t n_staged = 0;
+
+  LlamaIVFPQIndex(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaIVFPQIndex>(info)
+  {
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    if (options.Has("path"))
+    {
+      path = options.Get("path").As<Napi::String>().Utf8Value();
+      try
+      {
+        if (open())
+        {
+          return;
+        }
+      }
+      catch (const std::exception &e)
+      {
+        Napi::Error::New(Env(), e.what()).ThrowAsJavaScriptException();
+        return;
+      }
+    }
+
+    d = options.Has("dimensions") ? options.Get("dimensions").As<Napi::Number>().Uint32Value() : 0;
+    nlist = options.Has("lists") ? options.Get("lists").As<Napi::Number>().Uint32Value() : 1024;
+    m = options.Has("subquantizers") ? options.Get("subquantizers").As<Napi::Number>().Uint32Value() : std::max(1u, d / 16);
+    if (d == 0 || nlist == 0 || m == 0 || d % m != 0)
+    {
+      Napi::Error::New(Env(), "Invalid IVF-PQ options, dimensions must be a multiple of subquantizers").ThrowAsJavaScriptException();
+      return;
+    }
+    offsets.assign(nlist + 1, 0);
+    staged_ids.resize(nlist);
+    staged_codes.resize(nlist);
+  }
+
+  // False when there is no file yet, throws when the file is not a valid index.
+  bool open()
+  {
+    if (mapped.data(0, 1, path) == NULL)
+    {
+      return false;
+    }
+    const std::runtime_error invalid("Invalid IVF-PQ index file " + path);
+    const size_t header = 4 + 4 * 4 + 8;
+    const uint8_t *data = mapped.data(0, header, path);
+    if (data == NULL || std::memcmp(data, "LIVF", 4) != 0)
+    {
+      throw invalid;
+    }
+    uint32_t version;
+    uint64_t n;
+    std::memcpy(&version, data + 4, 4);
+    std::memcpy(&d, data + 8, 4);
+    std::memcpy(&nlist, data + 12, 4);
+    std::memcpy(&m, data + 16, 4);
+    std::memcpy(&n, data + 20, 8);
+    if (version != 1 || d == 0 || nlist == 0 || m == 0 || d % m != 0)
+    {
+      throw invalid;
+    }
+
+    const size_t n_centroids = (size_t)nlist * d;
+    const size_t n_codebooks = (size_t)ksub * d;
+    const size_t tables = header + (n_centroids + n_codebooks) * sizeof(float) + (nlist + 1) * sizeof(uint64_t);
+    data = mapped.data(0, tables, path);
+    if (data == NULL)
+    {
+      throw invalid;
+    }
+    offsets.resize(nlist + 1);
+    std::memcpy(offsets.data(), data + header + (n_centroids + n_codebooks) * sizeof(float), (nlist + 1) * sizeof(uint64_t));
+    for (uint32_t l = 0; l < nlist; ++l)
+    {
+      if (offsets[l + 1] < offsets[l])
+      {
+        throw invalid;
+      }
+    }
+    if (offsets[0] != 0 || offsets[nlist] != n || (n > 0 && mapped.data(tables, n * (sizeof(uint32_t) + m), path) == NULL))
+    {
+      throw invalid;
+    }
+    data = mapped.data(0, tables, path);
+    centroids.assign((const float *)(data + header), (const float *)(data + header) + n_centroids);
+    codebooks.assign((const float *)(data + header) + n_centroids, (const float *)(data + header) + n_centroids + n_codebooks);
+    data_offset = tables;
+    n_disk = n;
+    trained = true;
+    staged_ids.assign(nlist, std::vector<uint32_t>());
+    staged_codes.assign(nlist, std::vector<uint8_t>());
+    return true;
+  }
+
+  // ids and codes of a list in the file, or NULL when it is empty
+  const uint8_t *list(uint32_t l, size_t &count)
+  {
+    count = offsets[l + 1] - offsets[l];
+    if (count == 0)
+    {
+      return NULL;
+    }
+    return mapped.data(data_offset + offsets[l] * (sizeof(uint32_t) + m), count * (sizeof(uint32_t) + m), path);
+  }
+
+  Napi::Value Train(const Napi::CallbackInfo &info)
+  {
+    Napi::Float32Array samples = info[0].As<Napi::Float32Array>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    llama_node_kmeans_options _options;
+    if (options.Has("batchSize"))
+    {
+      _options.batch_size = options.Get("batchSize").As<Napi::Number>().Uint32Value();
+      _options.iterations = 100;
+    }
+    if (options.Has("iterations"))
+    {
+      _options.iterations = options.Get("iterations").As<Napi::Number>().Uint32Value();
+    }
+    if (options.Has("seed"))
+    {
+      _options.seed = options.Get("seed").As<Napi::Number>().Uint32Value();
+    }
+
+    if (trained)
+    {
+      Napi::Error::New(Env(), "Index is already trained").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    const size_t n = samples.ElementLength() / d;
+    if (samples.ElementLength() % d != 0 || n < nlist || n < ksub)
+    {
+      Napi::Error::New(Env(), "Training needs at least max(lists, 256) samples of the index dimensions").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    auto data = std::make_shared<std::vector<float>>(samples.Data(), samples.Data() + samples.ElementLength());
+
+    this->Ref();
+
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          const size_t dsub = d / m;
+          std::vector<float> _centroids((size_t)nlist * d);
+          llama_node_kmeans(data->data(), n, d, nlist, _options, _centroids.data());
+
+          // residuals to the nearest centroid, split into the m subspaces
+          const auto norms = llama_node_norms(_centroids.data(), nlist, d);
+          std::vector<float> residuals(n * d);
+          llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                                  {
+            for (size_t i = begin; i < end; ++i)
+            {
+              const float *x = data->data() + i * d;
+              const float *c = _centroids.data() + (size_t)llama_node_nearest(x, _centroids.data(), norms.data(), nlist, d) * d;
+              for (size_t j = 0; j < d; ++j)
+              {
+                residuals[i * d + j] = x[j] - c[j];
+              }
+            } });
+
+          std::vector<float> _codebooks((size_t)ksub * d);
+          std::vector<float> sub(n * dsub);
+          for (size_t s = 0; s < m; ++s)
+          {
+            for (size_t i = 0; i < n; ++i)
+            {
+              std::memcpy(sub.data() + i * dsub, residuals.data() + i * d + s * dsub, dsub * sizeof(float));
+            }
+            auto sub_options = _options;
+            sub_options.seed += s + 1;
+            llama_node_kmeans(sub.data(), n, dsub, ksub, sub_options, _codebooks.data() + s * ksub * dsub);
+          }
+
+          std::lock_guard<std::mutex> lock(mutex);
+          centroids.swap(_centroids);
+          codebooks.swap(_codebooks);
+          trained = true;
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  // Ids default to the number of vectors before, counting up. Resolves the number of vectors.
+  Napi::Value Add(const Napi::CallbackInfo &info)
+  {
+    Napi::Float32Array vectors = info[0].As<Napi::Float32Array>();
+    if (!trained)
+    {
+      Napi::Error::New(Env(), "Index is not trained").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (vectors.ElementLength() % d != 0)
+    {
+      Napi::Error::New(Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    const size_t n = vectors.ElementLength() / d;
+    auto data = std::make_shared<std::vector<float>>(vectors.Data(), vectors.Data() + vectors.ElementLength());
+    auto ids = std::make_shared<std::vector<uint32_t>>();
+    if (info.Length() > 1 && info[1].IsTypedArray())
+    {
+      Napi::Uint32Array _ids = info[1].As<Napi::Uint32Array>();
+      if (_ids.ElementLength() != n)
+      {
+        Napi::Error::New(Env(), "Number of ids differs from the number of vectors").ThrowAsJavaScriptException();
+        return Env().Undefined();
+      }
+      ids->assign(_ids.Data(), _ids.Data() + n);
+    }
+
+    this->Ref();
+
+    auto worker = new _AsyncWorkerWithResult<uint64_t>(
+        Env(),
+        [=]()
+        {
+          const size_t dsub = d / m;
+          const auto norms = llama_node_norms(centroids.data(), nlist, d);
+          std::vector<std::vector<float>> sub_norms(m);
+          for (size_t s = 0; s < m; ++s)
+          {
+            sub_norms[s] = llama_node_norms(codebooks.data() + s * ksub * dsub, ksub, dsub);
+          }
+
+          std::vector<uint32_t> lists(n);
+          std::vector<uint8_t> codes(n * m);
+          llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                                  {
+            std::vector<float> residual(d);
+            for (size_t i = begin; i < end; ++i)
+            {
+              const float *x = data->data() + i * d;
+              lists[i] = llama_node_nearest(x, centroids.data(), norms.data(), nlist, d);
+              const float *c = centroids.data() + (size_t)lists[i] * d;
+              for (size_t j = 0; j < d; ++j)
+              {
+                residual[j] = x[j] - c[j];
+              }
+              for (size_t s = 0; s < m; ++s)
+              {
+                codes[i * m + s] = llama_node_nearest(residual.data() + s * dsub, codebooks.data() + s * ksub * dsub, sub_norms[s].data(), ksub, dsub);
+              }
+            } });
+
+          std::lock_guard<std::mutex> lock(mutex);
+          const uint64_t first = n_disk + n_staged;
+          for (size_t i = 0; i < n; ++i)
+          {
+            staged_ids[lists[i]].push_back(ids->empty() ? (uint32_t)(first + i) : (*ids)[i]);
+            staged_codes[lists[i]].insert(staged_codes[lists[i]].end(), codes.begin() + i * m, codes.begin() + (i + 1) * m);
+          }
+          n_staged += n;
+          return n_disk + n_staged;
+        },
+        [=](Napi::Env env, uint64_t result)
+        {
+          return Napi::Number::New(env, result);
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  // Nearest k of each query by the asymmetric distance of the probed lists, in ascending order.
+  // Missing results have the id 0xFFFFFFFF and an infinite distance.
+  Napi::Value Search(const Napi::CallbackInfo &info)
+  {
+    Napi::Float32Array queries = info[0].As<Napi::Float32Array>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    const size_t k = options.Has("k") ? options.Get("k").As<Napi::Number>().Uint32Value() : 10;
+    const size_t nprobe = std::min<size_t>(nlist, options.Has("nprobe") ? options.Get("nprobe").As<Napi::Number>().Uint32Value() : 8);
+
+    if (k == 0)
+    {
+      Napi::Error::New(Env(), "k must be at least 1").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (!trained)
+    {
+      Napi::Error::New(Env(), "Index is not trained").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (queries.ElementLength() % d != 0)
+    {
+      Napi::Error::New(Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    const size_t nq = queries.ElementLength() / d;
+    auto data = std::make_shared<std::vector<float>>(queries.Data(), queries.Data() + queries.ElementLength());
+
+    typedef std::pair<std::vector<uint32_t>, std::vector<float>> result_t;
+
+    this->Ref();
+
+    auto worker = new _AsyncWorkerWithResult<std::shared_ptr<result_t>>(
+        Env(),
+        [=]()
+        {
+          auto result = std::make_shared<result_t>(std::vector<uint32_t>(nq * k, UINT32_MAX), std::vector<float>(nq * k, std::numeric_limits<float>::infinity()));
+          const size_t dsub = d / m;
+
+          std::lock_guard<std::mutex> lock(mutex);
+          // map the whole file once, so the workers only read it
+          if (n_disk > 0 && mapped.data(data_offset, (size_t)offsets[nlist] * (sizeof(uint32_t) + m), path) == NULL)
+          {
+            throw std::runtime_error("Failed to map " + path);
+          }
+
+          llama_node_parallel_for(nq, [&](size_t begin, size_t end)
+                                  {
+            std::vector<std::pair<float, uint32_t>> coarse(nlist);
+            std::vector<float> residual(d);
+            std::vector<float> table(m * ksub);
+            std::vector<std::pair<float, uint32_t>> heap;
+            for (size_t q = begin; q < end; ++q)
+            {
+              const float *x = data->data() + q * d;
+              for (uint32_t l = 0; l < nlist; ++l)
+              {
+                coarse[l] = std::make_pair(llama_node_l2(x, centroids.data() + (size_t)l * d, d), l);
+              }
+              std::partial_sort(coarse.begin(), coarse.begin() + nprobe, coarse.end());
+
+              heap.clear();
+              // ids in the file are not aligned unless m is a multiple of 4
+              auto scan = [&](const uint8_t *ids, const uint8_t *codes, size_t count)
+              {
+                for (size_t i = 0; i < count; ++i)
+                {
+                  float distance = 0;
+                  const uint8_t *code = codes + i * m;
+                  for (size_t s = 0; s < m; ++s)
+                  {
+                    distance += table[s * ksub + code[s]];
+                  }
+                  uint32_t id;
+                  if (heap.size() < k)
+                  {
+                    std::memcpy(&id, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+                    heap.emplace_back(distance, id);
+                    std::push_heap(heap.begin(), heap.end());
+                  }
+                  else if (distance < heap.front().first)
+                  {
+                    std::memcpy(&id, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = std::make_pair(distance, id);
+                    std::push_heap(heap.begin(), heap.end());
+                  }
+                }
+              };
+
+              for (size_t p = 0; p < nprobe; ++p)
+              {
+                const uint32_t l = coarse[p].second;
+                const float *c = centroids.data() + (size_t)l * d;
+                for (size_t j = 0; j < d; ++j)
+                {
+                  residual[j] = x[j] - c[j];
+                }
+                for (size_t s = 0; s < m; ++s)
+                {
+                  for (size_t code = 0; code < ksub; ++code)
+                  {
+                    table[s * ksub + code] = llama_node_l2(residual.data() + s * dsub, codebooks.data() + (s * ksub + code) * dsub, dsub);
+                  }
+                }
+                size_t count;
+                const uint8_t *disk = list(l, count);
+                if (disk != NULL)
+                {
+                  scan(disk, disk + count * sizeof(uint32_t), count);
+                }
+                scan((const uint8_t *)staged_ids[l].data(), staged_codes[l].data(), staged_ids[l].size());
+              }
+
+              std::sort_heap(heap.begin(), heap.end());
+              for (size_t i = 0; i < heap.size(); ++i)
+              {
+                result->first[q * k + i] = heap[i].second;
+                result->second[q * k + i] = heap[i].first;
+              }
+            } });
+          return result;
+        },
+        [=](Napi::Env env, std::shared_ptr<result_t> result) -> napi_value
+        {
+          Napi::Object value = Napi::Object::New(env);
+          Napi::Uint32Array ids = Napi::Uint32Array::New(env, result->first.size());
+          Napi::Float32Array distances = Napi::Float32Array::New(env, result->second.size());
+          std::copy(result->first.begin(), result->first.end(), ids.Data());
+          std::copy(result->second.begin(), result->second.end(), distances.Data());
+          value.Set("ids", ids);
+          value.Set("distances", distances);
+          return value;
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  // Writes the trained parameters and every list, merging the vectors added since the last save,
+  // to a new file which then replaces the mapped one.
+  Napi::Value Save(const Napi::CallbackInfo &info)
+  {
+    const std::string target = info.Length() > 0 && info[0].IsString() ? info[0].As<Napi::String>().Utf8Value() : path;
+    if (!trained || target.empty())
+    {
+      Napi::Error::New(Env(), trained ? "No path to save the index to" : "Index is not trained").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+
+    this->Ref();
+
+    auto worker = new _AsyncWorker(
+        Env(),
+        [=]()
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          const std::string temp = target + ".tmp";
+          FILE *file = std::fopen(temp.c_str(), "wb");
+          if (file == NULL)
+          {
+            throw std::runtime_error("Failed to write " + temp);
+          }
+          const uint32_t version = 1;
+          const uint64_t n = n_disk + n_staged;
+          std::vector<uint64_t> _offsets(nlist + 1, 0);
+          for (uint32_t l = 0; l < nlist; ++l)
+          {
+            _offsets[l + 1] = _offsets[l] + (offsets[l + 1] - offsets[l]) + staged_ids[l].size();
+          }
+          bool ok = std::fwrite("LIVF", 1, 4, file) == 4 &&
+                    std::fwrite(&version, 4, 1, file) == 1 &&
+                    std::fwrite(&d, 4, 1, file) == 1 &&
+                    std::fwrite(&nlist, 4, 1, file) == 1 &&
+                    std::fwrite(&m, 4, 1, file) == 1 &&
+                    std::fwrite(&n, 8, 1, file) == 1 &&
+                    std::fwrite(centroids.data(), sizeof(float), centroids.size(), file) == centroids.size() &&
+                    std::fwrite(codebooks.data(), sizeof(float), codebooks.size(), file) == codebooks.size() &&
+                    std::fwrite(_offsets.data(), sizeof(uint64_t), _offsets.size(), file) == _offsets.size();
+          for (uint32_t l = 0; ok && l < nlist; ++l)
+          {
+            size_t count;
+            const uint8_t *disk = list(l, count);
+            const auto &ids = staged_ids[l];
+            const auto &codes = staged_codes[l];
+            ok = (count == 0 || std::fwrite(disk, sizeof(uint32_t), count, file) == count) &&
+                 std::fwrite(ids.data(), sizeof(uint32_t), ids.size(), file) == ids.size() &&
+                 (count == 0 || std::fwrite(disk + count * sizeof(uint32_t), m, count, file) == count) &&
+                 std::fwrite(codes.data(), 1, codes.size(), file) == codes.size();
+          }
+          ok = std::fclose(file) == 0 && ok;
+          mapped.unmap();
+#ifdef _WIN32
+          std::remove(target.c_str());
+#endif
+          if (!ok || std::rename(temp.c_str(), target.c_str()) != 0)
+          {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Failed to write " + target);
+          }
+
+          path = target;
+          offsets.swap(_offsets);
+          data_offset = 4 + 4 * 4 + 8 + (centroids.size() + codebooks.size()) * sizeof(float) + (nlist + 1) * sizeof(uint64_t);
+          n_disk = n;
+          n_staged = 0;
+          staged_ids.assign(nlist, std::vector<uint32_t>());
+          staged_codes.assign(nlist, std::vector<uint8_t>());
+        },
+        [=]()
+        {
+          this->Unref();
+        });
+
+    worker->Queue(this);
+    return worker->Promise();
+  }
+
+  Napi::Value Stats(const Napi::CallbackInfo &info)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("dimensions", Napi::Number::From(Env(), d));
+    result.Set("lists", Napi::Number::From(Env(), nlist));
+    result.Set("subquantizers", Napi::Number::From(Env(), m));
+    result.Set("trained", Napi::Boolean::New(Env(), trained));
+    result.Set("vectors", Napi::Number::From(Env(), n_disk + n_staged));
+    result.Set("stagedVectors", Napi::Number::From(Env(), n_staged));
+    result.Set("memoryBytes", Napi::Number::From(Env(), (centroids.size() + codebooks.size()) * sizeof(float) + n_staged * (sizeof(uint32_t) + m)));
+    return result;
+  }
+
+  Napi::Value Dispose(const Napi::CallbackInfo &info)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    mapped.unmap();
+    std::vector<std::vector<uint32_t>>(nlist).swap(staged_ids);
+    std::vector<std::vector<uint8_t>>(nlist).swap(staged_codes);
+    n_staged = 0;
+    return Env().Undefined();
+  }
+
+  static void init(Napi::Object exports)
+  {
+    auto def = DefineClass(
+        exports.Env(),
+        "LlamaIVFPQIndex",
+        {
+            InstanceMethod("train", &LlamaIVFPQIndex::Train),
+            InstanceMethod("add", &LlamaIVFPQIndex::Add),
+            InstanceMethod("search", &LlamaIVFPQIndex::Search),
+            InstanceMethod("save", &LlamaIVFPQIndex::Save),
+            InstanceMethod("stats", &LlamaIVFPQIndex::Stats),
+            InstanceMethod("dispose", &LlamaIVFPQIndex::Dispose),
+        });
+    exports.Set("LlamaIVFPQIndex", def);
+  }
+};
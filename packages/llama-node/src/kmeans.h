@@ -0,0 +1,375 @@
+//
+//  kmeans.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "common.h"
+#include "worker.h"
+#include "simd.h"
+
+// Runs fn(begin, end) over [0, n) split across the hardware threads.
+template <typename F>
+static void llama_node_parallel_for(size_t n, F fn, size_t grain = 16)
+{
+  const size_t n_threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), n / grain));
+  if (n_threads == 1)
+  {
+    fn(0, n);
+    return;
+  }
+  std::vector<std::thread> threads;
+  const size_t chunk = (n + n_threads - 1) / n_threads;
+  for (size_t t = 0; t < n_threads; ++t)
+  {
+    const size_t begin = t * chunk;
+    const size_t end = std::min(n, begin + chunk);
+    if (begin < end)
+    {
+      threads.emplace_back([=]()
+                           { fn(begin, end); });
+    }
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+}
+
+static inline float llama_node_l2(const float *a, const float *b, size_t d)
+{
+  float sum = 0;
+  for (size_t i = 0; i < d; ++i)
+  {
+    const float diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+// Index of the nearest of k centroids, by ||c||^2 - 2 x.c with the norms of the centroids precomputed.
+// The distance, less ||x||^2, is written to distance when given.
+static inline uint32_t llama_node_nearest(const float *x, const float *centroids, const float *norms, size_t k, size_t d, float *distance = NULL)
+{
+  uint32_t best = 0;
+  float best_distance = std::numeric_limits<float>::infinity();
+  for (size_t c = 0; c < k; ++c)
+  {
+    const float _distance = norms[c] - 2 * llama_node_dot(x, centroids + c * d, d);
+    if (_distance < best_distance)
+    {
+      best_distance = _distance;
+      best = c;
+    }
+  }
+  if (distance != NULL)
+  {
+    *distance = best_distance;
+  }
+  return best;
+}
+
+static std::vector<float> llama_node_norms(const float *centroids, size_t k, size_t d)
+{
+  std::vector<float> norms(k);
+  for (size_t c = 0; c < k; ++c)
+  {
+    norms[c] = llama_node_dot(centroids + c * d, centroids + c * d, d);
+  }
+  return norms;
+}
+
+struct llama_node_kmeans_options
+{
+  size_t iterations = 20;
+  // points of each mini-batch step, or 0 for full passes of Lloyd's algorithm
+  size_t batch_size = 0;
+  // seeds with k-means++ on a sample of 64 points a cluster, otherwise with random points
+  bool plus_plus = true;
+  uint32_t seed = 0;
+};
+
+static void llama_node_kmeans_seed(const float *data, size_t n, size_t d, size_t k, const llama_node_kmeans_options &options, std::mt19937 &rng, float *centroids)
+{
+  const size_t n_sample = std::min<size_t>(n, options.plus_plus ? 64 * k : k);
+  std::vector<size_t> sample(n_sample);
+  if (n_sample == n)
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      sample[i] = i;
+    }
+    std::shuffle(sample.begin(), sample.end(), rng);
+  }
+  else
+  {
+    for (size_t i = 0; i < n_sample; ++i)
+    {
+      sample[i] = rng() % n;
+    }
+  }
+
+  if (!options.plus_plus)
+  {
+    for (size_t c = 0; c < k; ++c)
+    {
+      std::memcpy(centroids + c * d, data + sample[c % n_sample] * d, d * sizeof(float));
+    }
+    return;
+  }
+
+  // each next centroid is a sample point drawn with probability proportional to its squared
+  // distance to the nearest centroid so far
+  std::vector<float> nearest(n_sample, std::numeric_limits<float>::infinity());
+  std::uniform_real_distribution<double> uniform(0, 1);
+  size_t next = sample[0];
+  for (size_t c = 0; c < k; ++c)
+  {
+    const float *centroid = centroids + c * d;
+    std::memcpy(centroids + c * d, data + next * d, d * sizeof(float));
+    llama_node_parallel_for(n_sample, [&](size_t begin, size_t end)
+                            {
+      for (size_t i = begin; i < end; ++i)
+      {
+        nearest[i] = std::min(nearest[i], llama_node_l2(data + sample[i] * d, centroid, d));
+      } });
+
+    double total = 0;
+    for (size_t i = 0; i < n_sample; ++i)
+    {
+      total += nearest[i];
+    }
+    double target = uniform(rng) * total;
+    next = sample[rng() % n_sample];
+    for (size_t i = 0; i < n_sample && total > 0; ++i)
+    {
+      target -= nearest[i];
+      if (target <= 0)
+      {
+        next = sample[i];
+        break;
+      }
+    }
+  }
+}
+
+// Clusters n row major points of d dimensions into k centroids, and writes the nearest centroid of
+// every point to assignment when given. Returns the sum of squared distances of the assignment.
+static double llama_node_kmeans(const float *data, size_t n, size_t d, size_t k, const llama_node_kmeans_options &options, float *centroids, uint32_t *assignment = NULL)
+{
+  std::mt19937 rng(options.seed);
+  llama_node_kmeans_seed(data, n, d, k, options, rng, centroids);
+
+  std::vector<size_t> counts(k);
+  if (options.batch_size > 0)
+  {
+    // Sculley's mini-batch k-means, each centroid moves towards its points at a rate of one over
+    // the points it has been assigned so far
+    const size_t batch_size = std::min(options.batch_size, n);
+    std::vector<size_t> batch(batch_size);
+    std::vector<uint32_t> nearest(batch_size);
+    for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+    {
+      for (size_t i = 0; i < batch_size; ++i)
+      {
+        batch[i] = rng() % n;
+      }
+      const auto norms = llama_node_norms(centroids, k, d);
+      llama_node_parallel_for(batch_size, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+          nearest[i] = llama_node_nearest(data + batch[i] * d, centroids, norms.data(), k, d);
+        } });
+      for (size_t i = 0; i < batch_size; ++i)
+      {
+        const float *x = data + batch[i] * d;
+        float *centroid = centroids + (size_t)nearest[i] * d;
+        const float eta = 1.0f / ++counts[nearest[i]];
+        for (size_t j = 0; j < d; ++j)
+        {
+          centroid[j] += eta * (x[j] - centroid[j]);
+        }
+      }
+    }
+  }
+  else
+  {
+    std::vector<uint32_t> nearest(n);
+    std::vector<double> sums(k * d);
+    for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+    {
+      const auto norms = llama_node_norms(centroids, k, d);
+      llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+          nearest[i] = llama_node_nearest(data + i * d, centroids, norms.data(), k, d);
+        } });
+
+      std::fill(counts.begin(), counts.end(), 0);
+      for (size_t i = 0; i < n; ++i)
+      {
+        counts[nearest[i]]++;
+      }
+      // threads own ranges of dimensions, so the sums need no locks or copies
+      llama_node_parallel_for(d, [&](size_t begin, size_t end)
+                              {
+        for (size_t c = 0; c < k; ++c)
+        {
+          std::fill(sums.begin() + c * d + begin, sums.begin() + c * d + end, 0.0);
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+          const float *x = data + i * d;
+          double *sum = sums.data() + (size_t)nearest[i] * d;
+          for (size_t j = begin; j < end; ++j)
+          {
+            sum[j] += x[j];
+          }
+        } }, 1);
+      for (size_t c = 0; c < k; ++c)
+      {
+        if (counts[c] == 0)
+        {
+          // an empty cluster restarts from a random point
+          std::memcpy(centroids + c * d, data + (rng() % n) * d, d * sizeof(float));
+          continue;
+        }
+        for (size_t j = 0; j < d; ++j)
+        {
+          centroids[c * d + j] = sums[c * d + j] / counts[c];
+        }
+      }
+    }
+  }
+
+  if (assignment == NULL)
+  {
+    return 0;
+  }
+  const auto norms = llama_node_norms(centroids, k, d);
+  std::mutex mutex;
+  double inertia = 0;
+  llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                          {
+    double sum = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+      float distance;
+      assignment[i] = llama_node_nearest(data + i * d, centroids, norms.data(), k, d, &distance);
+      sum += std::max(0.0f, distance + llama_node_dot(data + i * d, data + i * d, d));
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    inertia += sum; });
+  return inertia;
+}
+
+// The matrix is referenced rather than copied while clustering, so it must not be modified until
+// the promise settles.
+Napi::Value kmeans(const Napi::CallbackInfo &info)
+{
+  Napi::Float32Array matrix = info[0].As<Napi::Float32Array>();
+  const size_t d = info[1].As<Napi::Number>().Uint32Value();
+  const size_t k = info[2].As<Napi::Number>().Uint32Value();
+  Napi::Object options = info[3].As<Napi::Object>();
+
+  if (d == 0 || matrix.ElementLength() % d != 0)
+  {
+    Napi::Error::New(info.Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+  const size_t n = matrix.ElementLength() / d;
+  if (k == 0 || k > n)
+  {
+    Napi::Error::New(info.Env(), "Number of clusters must be between 1 and the number of vectors").ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  llama_node_kmeans_options _options;
+  if (options.Has("batchSize"))
+  {
+    _options.batch_size = options.Get("batchSize").As<Napi::Number>().Uint32Value();
+    _options.iterations = 100;
+  }
+  if (options.Has("iterations"))
+  {
+    _options.iterations = options.Get("iterations").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("init"))
+  {
+    _options.plus_plus = options.Get("init").As<Napi::String>().Utf8Value() != "random";
+  }
+  if (options.Has("seed"))
+  {
+    _options.seed = options.Get("seed").As<Napi::Number>().Uint32Value();
+  }
+
+  const float *data = matrix.Data();
+  auto reference = new Napi::Reference<Napi::Float32Array>(Napi::Persistent(matrix));
+
+  struct result_t
+  {
+    std::vector<float> centroids;
+    std::vector<uint32_t> assignments;
+    double inertia;
+  };
+
+  auto worker = new _AsyncWorkerWithResult<std::shared_ptr<result_t>>(
+      info.Env(),
+      [=]()
+      {
+        auto result = std::make_shared<result_t>();
+        result->centroids.resize(k * d);
+        result->assignments.resize(n);
+        result->inertia = llama_node_kmeans(data, n, d, k, _options, result->centroids.data(), result->assignments.data());
+        return result;
+      },
+      [=](Napi::Env env, std::shared_ptr<result_t> result) -> napi_value
+      {
+        Napi::Object value = Napi::Object::New(env);
+        Napi::Float32Array centroids = Napi::Float32Array::New(env, result->centroids.size());
+        Napi::Uint32Array assignments = Napi::Uint32Array::New(env, result->assignments.size());
+        std::copy(result->centroids.begin(), result->centroids.end(), centroids.Data());
+        std::copy(result->assignments.begin(), result->assignments.end(), assignments.Data());
+        value.Set("centroids", centroids);
+        value.Set("assignments", assignments);
+        value.Set("inertia", Napi::Number::New(env, result->inertia));
+        return value;
+      },
+      [=]()
+      {
+        delete reference;
+      });
+
+  worker->Queue();
+  return worker->Promise();
+}
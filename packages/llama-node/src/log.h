@@ -25,8 +25,325 @@
 
 #pragma once
 
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
 #include "common.h"
 
+#define LLAMA_NODE_LOG_CAPACITY 1024
+#define LLAMA_NODE_LOG_TEXT_SIZE 496
+
+struct llama_node_log_record
+{
+  std::atomic<size_t> sequence;
+  double timestamp;
+  int32_t level;
+  bool cont;
+  char text[LLAMA_NODE_LOG_TEXT_SIZE];
+};
+
+// Bounded multi-producer multi-consumer queue of log records. Producers never block:
+// when the buffer is full the oldest record is evicted, and the newest one is dropped
+// only when the eviction keeps losing the race against other producers.
+class LogRingBuffer
+{
+public:
+  std::atomic<int32_t> level{GGML_LOG_LEVEL_WARN};
+  std::atomic<uint64_t> dropped{0};
+
+  LogRingBuffer()
+  {
+    for (size_t i = 0; i < LLAMA_NODE_LOG_CAPACITY; ++i)
+    {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  void push(int32_t level, bool cont, const char *text)
+  {
+    for (int retry = 0; retry < 4; ++retry)
+    {
+      size_t pos = head.load(std::memory_order_relaxed);
+      while (true)
+      {
+        auto &slot = slots[pos % LLAMA_NODE_LOG_CAPACITY];
+        const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0)
+        {
+          if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            slot.timestamp = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+            slot.level = level;
+            slot.cont = cont;
+            strncpy(slot.text, text, LLAMA_NODE_LOG_TEXT_SIZE - 1);
+            slot.text[LLAMA_NODE_LOG_TEXT_SIZE - 1] = 0;
+            slot.sequence.store(pos + 1, std::memory_order_release);
+            return;
+          }
+        }
+        else if (diff < 0)
+        {
+          break;
+        }
+        else
+        {
+          pos = head.load(std::memory_order_relaxed);
+        }
+      }
+      if (pop(nullptr))
+      {
+        ++dropped;
+      }
+    }
+    ++dropped;
+  }
+
+  template <typename F>
+  bool pop(F *consumer)
+  {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto &slot = slots[pos % LLAMA_NODE_LOG_CAPACITY];
+      const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+      if (diff == 0)
+      {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          if (consumer != NULL)
+          {
+            (*consumer)(slot);
+          }
+          slot.sequence.store(pos + LLAMA_NODE_LOG_CAPACITY, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(std::nullptr_t)
+  {
+    return pop<void (*)(llama_node_log_record &)>(NULL);
+  }
+
+  size_t pending() const
+  {
+    const size_t _head = head.load(std::memory_order_relaxed);
+    const size_t _tail = tail.load(std::memory_order_relaxed);
+    return _head > _tail ? _head - _tail : 0;
+  }
+
+private:
+  llama_node_log_record slots[LLAMA_NODE_LOG_CAPACITY];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
+
+static LogRingBuffer &llama_node_logs()
+{
+  static LogRingBuffer buffer;
+  return buffer;
+}
+
+struct LogSubscription
+{
+  std::mutex mutex;
+  std::atomic<bool> active{false};
+  std::atomic<bool> notifying{false};
+  Napi::ThreadSafeFunction tsfn;
+};
+
+static LogSubscription &llama_node_log_subscription()
+{
+  static LogSubscription subscription;
+  return subscription;
+}
+
+static void llama_node_log_notify();
+
 static void llama_log_callback(ggml_log_level level, const char *text, void *user_data)
 {
+  static thread_local int32_t last_level = GGML_LOG_LEVEL_NONE;
+
+  auto &logs = llama_node_logs();
+  const bool cont = level == GGML_LOG_LEVEL_CONT;
+  const int32_t resolved_level = cont ? last_level : level;
+  if (!cont)
+  {
+    last_level = level;
+  }
+
+  const int32_t min_level = logs.level.load(std::memory_order_relaxed);
+  if (min_level == GGML_LOG_LEVEL_NONE || resolved_level == GGML_LOG_LEVEL_NONE || resolved_level < min_level)
+  {
+    return;
+  }
+
+  logs.push(resolved_level, cont, text);
+
+  if (llama_node_log_subscription().active.load(std::memory_order_relaxed))
+  {
+    llama_node_log_notify();
+  }
+}
+
+// The component which emitted a record, taken from the `name: ` prefix used by llama.cpp and ggml.
+static std::string llama_node_log_source(const std::string &text)
+{
+  size_t i = 0;
+  while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_'))
+  {
+    ++i;
+  }
+  if (i == 0 || i >= text.size() || text[i] != ':')
+  {
+    return "";
+  }
+  return text.substr(0, i);
+}
+
+static Napi::Array llama_node_drain_logs(Napi::Env env, size_t max)
+{
+  struct Record
+  {
+    double timestamp;
+    int32_t level;
+    std::string text;
+  };
+  std::vector<Record> records;
+
+  auto consumer = [&](llama_node_log_record &slot)
+  {
+    if (slot.cont && !records.empty())
+    {
+      records.back().text += slot.text;
+      return;
+    }
+    Record record;
+    record.timestamp = slot.timestamp;
+    record.level = slot.level;
+    record.text = slot.text;
+    records.push_back(record);
+  };
+
+  auto &logs = llama_node_logs();
+  while (records.size() < max && logs.pop(&consumer))
+  {
+  }
+
+  Napi::Array result = Napi::Array::New(env, records.size());
+  for (size_t i = 0; i < records.size(); ++i)
+  {
+    std::string text = records[i].text;
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+    {
+      text.pop_back();
+    }
+    Napi::Object record = Napi::Object::New(env);
+    record.Set("timestamp", Napi::Number::New(env, records[i].timestamp));
+    record.Set("level", Napi::Number::New(env, records[i].level));
+    record.Set("source", Napi::String::New(env, llama_node_log_source(text)));
+    record.Set("text", Napi::String::New(env, text));
+    result[i] = record;
+  }
+  return result;
+}
+
+static void llama_node_log_notify()
+{
+  auto &subscription = llama_node_log_subscription();
+  if (subscription.notifying.exchange(true))
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(subscription.mutex);
+  if (!subscription.active)
+  {
+    subscription.notifying = false;
+    return;
+  }
+  auto status = subscription.tsfn.NonBlockingCall(
+      [](Napi::Env env, Napi::Function callback)
+      {
+        llama_node_log_subscription().notifying = false;
+        auto records = llama_node_drain_logs(env, SIZE_MAX);
+        if (records.Length() > 0)
+        {
+          callback.Call({records});
+        }
+      });
+  if (status != napi_ok)
+  {
+    subscription.notifying = false;
+  }
+}
+
+Napi::Value setLogLevel(const Napi::CallbackInfo &info)
+{
+  llama_node_logs().level = info[0].As<Napi::Number>().Int32Value();
+  return info.Env().Undefined();
+}
+
+Napi::Value getLogLevel(const Napi::CallbackInfo &info)
+{
+  return Napi::Number::New(info.Env(), llama_node_logs().level);
+}
+
+Napi::Value drainLogs(const Napi::CallbackInfo &info)
+{
+  size_t max = SIZE_MAX;
+  if (info[0].IsNumber())
+  {
+    max = info[0].As<Napi::Number>().Uint32Value();
+  }
+  return llama_node_drain_logs(info.Env(), max);
+}
+
+Napi::Value getLogStats(const Napi::CallbackInfo &info)
+{
+  Napi::Object result = Napi::Object::New(info.Env());
+  result.Set("pending", Napi::Number::From(info.Env(), llama_node_logs().pending()));
+  result.Set("dropped", Napi::Number::From(info.Env(), llama_node_logs().dropped.load()));
+  return result;
+}
+
+Napi::Value subscribeLogs(const Napi::CallbackInfo &info)
+{
+  auto &subscription = llama_node_log_subscription();
+  std::lock_guard<std::mutex> lock(subscription.mutex);
+  if (subscription.active)
+  {
+    subscription.active = false;
+    subscription.tsfn.Release();
+  }
+  subscription.tsfn = Napi::ThreadSafeFunction::New(info.Env(), info[0].As<Napi::Function>(), "llama_log", 0, 1);
+  subscription.tsfn.Unref(info.Env());
+  subscription.notifying = false;
+  subscription.active = true;
+  return info.Env().Undefined();
+}
+
+Napi::Value unsubscribeLogs(const Napi::CallbackInfo &info)
+{
+  auto &subscription = llama_node_log_subscription();
+  std::lock_guard<std::mutex> lock(subscription.mutex);
+  if (subscription.active)
+  {
+    subscription.active = false;
+    subscription.tsfn.Release();
+  }
+  return info.Env().Undefined();
 }
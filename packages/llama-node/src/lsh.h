@@ -0,0 +1,247 @@
+//
+//  lsh.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+#include "common.h"
+#include "worker.h"
+#include "simd.h"
+#include "kmeans.h"
+
+struct llama_node_lsh_options
+{
+  float threshold = 0.9f;
+  // hash tables, or 0 for as many as keep a 99% chance of a pair at the threshold sharing one
+  size_t bands = 0;
+  // bits of each band, or 0 for the most which keep that chance with the bands, but no fewer than
+  // log2(n) so unrelated vectors rarely share a bucket
+  size_t band_bits = 0;
+  // buckets larger than this are skipped, or 0 for no limit
+  size_t max_bucket_size = 0;
+  uint32_t seed = 0;
+};
+
+// Bits and bands such that two vectors at the threshold, which agree on a random hyperplane with
+// probability 1 - angle / pi, share at least one of the bands with 99% chance. Bands get at least
+// log2(n) bits, so a bucket holds about one unrelated vector and verification stays near linear;
+// more bands make up for the narrower buckets, up to 1024.
+static void llama_node_lsh_bands(const llama_node_lsh_options &options, size_t n, size_t &bits, size_t &bands)
+{
+  const double p = 1 - std::acos(std::max(-1.0f, std::min(1.0f, options.threshold))) / std::acos(-1.0);
+  const size_t min_bits = std::min<size_t>(64, std::max<size_t>(1, (size_t)std::ceil(std::log2((double)std::max<size_t>(n, 2)))));
+  bands = options.bands > 0 ? options.bands : 64;
+  if (options.band_bits > 0)
+  {
+    bits = std::min<size_t>(options.band_bits, 64);
+  }
+  else if (p >= 1)
+  {
+    bits = 64;
+  }
+  else
+  {
+    const double target = 1 - std::pow(0.01, 1.0 / bands);
+    bits = (size_t)std::max<double>(min_bits, std::min(64.0, std::floor(std::log(target) / std::log(p))));
+  }
+  if (options.bands == 0 && p < 1)
+  {
+    const double q = std::pow(p, (double)bits);
+    const double needed = q > 0 ? std::ceil(std::log(0.01) / std::log1p(-q)) : 1024;
+    bands = (size_t)std::max<double>(bands, std::min(1024.0, needed));
+  }
+}
+
+// Pairs (i < j) of the n row major vectors with a cosine similarity of at least the threshold,
+// sorted, with their similarities. Candidates share the random hyperplane signature of a band,
+// and the bands are hashed one at a time so only n keys are kept at once.
+static void llama_node_near_duplicates(const float *data, size_t n, size_t d, const llama_node_lsh_options &options, std::vector<std::pair<uint32_t, uint32_t>> &pairs, std::vector<float> &similarities)
+{
+  size_t bits, bands;
+  llama_node_lsh_bands(options, n, bits, bands);
+
+  std::vector<float> inverse_norms(n);
+  llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                          {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const float norm = std::sqrt(llama_node_dot(data + i * d, data + i * d, d));
+      inverse_norms[i] = norm > 0 ? 1 / norm : 0;
+    } });
+
+  std::mt19937 rng(options.seed);
+  std::normal_distribution<float> normal;
+  std::vector<float> planes(bits * d);
+  std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+  std::vector<std::pair<size_t, size_t>> buckets;
+  std::vector<std::pair<std::pair<uint32_t, uint32_t>, float>> found;
+  std::mutex mutex;
+
+  for (size_t band = 0; band < bands; ++band)
+  {
+    for (auto &x : planes)
+    {
+      x = normal(rng);
+    }
+    llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                            {
+      for (size_t i = begin; i < end; ++i)
+      {
+        uint64_t key = 0;
+        for (size_t b = 0; b < bits; ++b)
+        {
+          key = (key << 1) | (llama_node_dot(data + i * d, planes.data() + b * d, d) > 0 ? 1 : 0);
+        }
+        keys[i] = std::make_pair(key, (uint32_t)i);
+      } });
+    std::sort(keys.begin(), keys.end());
+
+    buckets.clear();
+    for (size_t begin = 0, end; begin < n; begin = end)
+    {
+      for (end = begin + 1; end < n && keys[end].first == keys[begin].first; ++end)
+      {
+      }
+      if (end - begin > 1 && (options.max_bucket_size == 0 || end - begin <= options.max_bucket_size))
+      {
+        buckets.emplace_back(begin, end);
+      }
+    }
+
+    llama_node_parallel_for(buckets.size(), [&](size_t begin, size_t end)
+                            {
+      std::vector<std::pair<std::pair<uint32_t, uint32_t>, float>> _found;
+      for (size_t b = begin; b < end; ++b)
+      {
+        for (size_t x = buckets[b].first; x < buckets[b].second; ++x)
+        {
+          for (size_t y = x + 1; y < buckets[b].second; ++y)
+          {
+            const uint32_t i = std::min(keys[x].second, keys[y].second);
+            const uint32_t j = std::max(keys[x].second, keys[y].second);
+            const float similarity = llama_node_dot(data + (size_t)i * d, data + (size_t)j * d, d) * inverse_norms[i] * inverse_norms[j];
+            if (similarity >= options.threshold)
+            {
+              _found.emplace_back(std::make_pair(i, j), similarity);
+            }
+          }
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      found.insert(found.end(), _found.begin(), _found.end()); }, 1);
+
+    // pairs sharing several bands are verified again, but only kept once
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end(), [](const std::pair<std::pair<uint32_t, uint32_t>, float> &a, const std::pair<std::pair<uint32_t, uint32_t>, float> &b)
+                            { return a.first == b.first; }),
+                found.end());
+  }
+
+  pairs.resize(found.size());
+  similarities.resize(found.size());
+  for (size_t i = 0; i < found.size(); ++i)
+  {
+    pairs[i] = found[i].first;
+    similarities[i] = found[i].second;
+  }
+}
+
+// The matrix is referenced rather than copied while hashing, so it must not be modified until
+// the promise settles.
+Napi::Value nearDuplicates(const Napi::CallbackInfo &info)
+{
+  Napi::Float32Array matrix = info[0].As<Napi::Float32Array>();
+  const size_t d = info[1].As<Napi::Number>().Uint32Value();
+  Napi::Object options = info[2].As<Napi::Object>();
+
+  if (d == 0 || matrix.ElementLength() % d != 0)
+  {
+    Napi::Error::New(info.Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+  const size_t n = matrix.ElementLength() / d;
+
+  llama_node_lsh_options _options;
+  if (options.Has("threshold"))
+  {
+    _options.threshold = options.Get("threshold").As<Napi::Number>().FloatValue();
+  }
+  if (options.Has("bands"))
+  {
+    _options.bands = std::max(1u, options.Get("bands").As<Napi::Number>().Uint32Value());
+  }
+  if (options.Has("bandBits"))
+  {
+    _options.band_bits = options.Get("bandBits").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("maxBucketSize"))
+  {
+    _options.max_bucket_size = options.Get("maxBucketSize").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("seed"))
+  {
+    _options.seed = options.Get("seed").As<Napi::Number>().Uint32Value();
+  }
+
+  const float *data = matrix.Data();
+  auto reference = new Napi::Reference<Napi::Float32Array>(Napi::Persistent(matrix));
+
+  typedef std::pair<std::vector<std::pair<uint32_t, uint32_t>>, std::vector<float>> result_t;
+
+  auto worker = new _AsyncWorkerWithResult<std::shared_ptr<result_t>>(
+      info.Env(),
+      [=]()
+      {
+        auto result = std::make_shared<result_t>();
+        llama_node_near_duplicates(data, n, d, _options, result->first, result->second);
+        return result;
+      },
+      [=](Napi::Env env, std::shared_ptr<result_t> result) -> napi_value
+      {
+        Napi::Object value = Napi::Object::New(env);
+        Napi::Uint32Array pairs = Napi::Uint32Array::New(env, result->first.size() * 2);
+        Napi::Float32Array similarities = Napi::Float32Array::New(env, result->second.size());
+        for (size_t i = 0; i < result->first.size(); ++i)
+        {
+          pairs[i * 2] = result->first[i].first;
+          pairs[i * 2 + 1] = result->first[i].second;
+        }
+        std::copy(result->second.begin(), result->second.end(), similarities.Data());
+        value.Set("pairs", pairs);
+        value.Set("similarities", similarities);
+        return value;
+      },
+      [=]()
+      {
+        delete reference;
+      });
+
+  worker->Queue();
+  return worker->Promise();
+}
@@ -0,0 +1,230 @@
+//
+//  memory.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+
+#include "common.h"
+
+struct llama_node_memory_usage
+{
+  int64_t weights = 0;
+  int64_t kv_allocated = 0;
+  int64_t kv_used = 0;
+  int64_t compute = 0;
+  int64_t host = 0;
+  int64_t device = 0;
+
+  int64_t total() const
+  {
+    return weights + kv_allocated + compute;
+  }
+};
+
+// Process wide totals of everything currently reported by live models and contexts.
+struct llama_node_memory_totals
+{
+  std::atomic<int64_t> weights{0};
+  std::atomic<int64_t> kv_allocated{0};
+  std::atomic<int64_t> kv_used{0};
+  std::atomic<int64_t> compute{0};
+  std::atomic<int64_t> host{0};
+  std::atomic<int64_t> device{0};
+};
+
+static llama_node_memory_totals &llama_node_memory()
+{
+  static llama_node_memory_totals totals;
+  return totals;
+}
+
+// The last usage reported by one object.
+class ExternalMemory
+{
+public:
+  llama_node_memory_usage reported;
+
+  void update(Napi::Env env, const llama_node_memory_usage &usage)
+  {
+    auto &totals = llama_node_memory();
+    totals.weights += usage.weights - reported.weights;
+    totals.kv_allocated += usage.kv_allocated - reported.kv_allocated;
+    totals.kv_used += usage.kv_used - reported.kv_used;
+    totals.compute += usage.compute - reported.compute;
+    totals.host += usage.host - reported.host;
+    totals.device += usage.device - reported.device;
+
+    const int64_t delta = usage.total() - reported.total();
+    if (delta != 0)
+    {
+      Napi::MemoryManagement::AdjustExternalMemory(env, delta);
+    }
+    reported = usage;
+  }
+
+  void release(Napi::Env env)
+  {
+    update(env, llama_node_memory_usage());
+  }
+};
+
+static Napi::Object getNapiMemoryUsage(Napi::Env env, const llama_node_memory_usage &usage)
+{
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("weights", Napi::Number::From(env, usage.weights));
+  result.Set("kvAllocated", Napi::Number::From(env, usage.kv_allocated));
+  result.Set("kvUsed", Napi::Number::From(env, usage.kv_used));
+  result.Set("compute", Napi::Number::From(env, usage.compute));
+  result.Set("host", Napi::Number::From(env, usage.host));
+  result.Set("device", Napi::Number::From(env, usage.device));
+  result.Set("total", Napi::Number::From(env, usage.total()));
+  return result;
+}
+
+// Fraction of the model layers offloaded to a GPU backend (the output layer counts as one extra layer).
+static double llama_node_offload_ratio(const llama_model *model, const llama_model_params &params)
+{
+  if (!llama_supports_gpu_offload() || params.n_gpu_layers == 0)
+  {
+    return 0;
+  }
+  const int32_t n_layer = llama_model_n_layer(model) + 1;
+  if (params.n_gpu_layers < 0 || params.n_gpu_layers >= n_layer)
+  {
+    return 1;
+  }
+  return (double)params.n_gpu_layers / n_layer;
+}
+
+static llama_node_memory_usage llama_node_model_memory_usage(const llama_model *model, const llama_model_params &params)
+{
+  llama_node_memory_usage usage;
+  if (model == NULL)
+  {
+    return usage;
+  }
+  usage.weights = llama_model_size(model);
+  usage.device = (int64_t)(usage.weights * llama_node_offload_ratio(model, params));
+  usage.host = usage.weights - usage.device;
+  return usage;
+}
+
+// Bytes of K and V cache needed to hold one position across all layers.
+static size_t llama_node_kv_bytes_per_token(const llama_model *model, const llama_context_params &params)
+{
+  const int64_t n_embd = llama_model_n_embd(model);
+  const int64_t n_head = std::max(1, llama_model_n_head(model));
+  const int64_t n_head_kv = std::max(1, llama_model_n_head_kv(model));
+  const int64_t n_embd_gqa = n_embd / n_head * n_head_kv;
+  return llama_model_n_layer(model) * (ggml_row_size(params.type_k, n_embd_gqa) + ggml_row_size(params.type_v, n_embd_gqa));
+}
+
+// Upper bound of the graph scratch buffers for one ubatch.
+static size_t llama_node_compute_bytes(const llama_model *model, const llama_context_params &params, uint32_t n_ctx, uint32_t n_ubatch)
+{
+  const size_t n_embd = llama_model_n_embd(model);
+  const size_t n_head = llama_model_n_head(model);
+  const size_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+  const size_t activations = n_ubatch * n_embd * 8;
+  const size_t attention = params.flash_attn ? 0 : (size_t)n_ubatch * n_ctx * n_head;
+  const size_t logits = params.embeddings ? 0 : n_ubatch * n_vocab;
+  return (activations + attention + logits) * sizeof(float);
+}
+
+static size_t llama_node_kv_cells_used(llama_context *ctx)
+{
+  auto mem = llama_get_memory(ctx);
+  size_t used = 0;
+  for (uint32_t seq = 0; seq < llama_n_seq_max(ctx); ++seq)
+  {
+    const llama_pos pos_max = llama_memory_seq_pos_max(mem, seq);
+    if (pos_max < 0)
+    {
+      continue;
+    }
+    used += pos_max - llama_memory_seq_pos_min(mem, seq) + 1;
+  }
+  return std::min<size_t>(used, llama_n_ctx(ctx));
+}
+
+static llama_node_memory_usage llama_node_context_memory_usage(llama_context *ctx, const llama_model_params &model_params, const llama_context_params &params)
+{
+  llama_node_memory_usage usage;
+  if (ctx == NULL)
+  {
+    return usage;
+  }
+  const llama_model *model = llama_get_model(ctx);
+  const size_t per_token = llama_node_kv_bytes_per_token(model, params);
+  const double ratio = llama_node_offload_ratio(model, model_params);
+
+  usage.kv_allocated = llama_n_ctx(ctx) * per_token;
+  usage.kv_used = llama_node_kv_cells_used(ctx) * per_token;
+  usage.compute = llama_node_compute_bytes(model, params, llama_n_ctx(ctx), llama_n_ubatch(ctx));
+
+  const int64_t kv_device = params.offload_kqv ? (int64_t)(usage.kv_allocated * ratio) : 0;
+  const int64_t compute_device = ratio > 0 ? usage.compute : 0;
+  usage.device = kv_device + compute_device;
+  usage.host = usage.kv_allocated + usage.compute - usage.device;
+  return usage;
+}
+
+Napi::Value getMemoryUsage(const Napi::CallbackInfo &info)
+{
+  auto &totals = llama_node_memory();
+
+  llama_node_memory_usage usage;
+  usage.weights = totals.weights;
+  usage.kv_allocated = totals.kv_allocated;
+  usage.kv_used = totals.kv_used;
+  usage.compute = totals.compute;
+  usage.host = totals.host;
+  usage.device = totals.device;
+
+  Napi::Object result = getNapiMemoryUsage(info.Env(), usage);
+
+  const size_t n_devices = ggml_backend_dev_count();
+  Napi::Array devices = Napi::Array::New(info.Env(), n_devices);
+  for (size_t i = 0; i < n_devices; ++i)
+  {
+    auto dev = ggml_backend_dev_get(i);
+    size_t free = 0;
+    size_t total = 0;
+    ggml_backend_dev_memory(dev, &free, &total);
+
+    Napi::Object device = Napi::Object::New(info.Env());
+    device.Set("name", Napi::String::New(info.Env(), ggml_backend_dev_name(dev)));
+    device.Set("description", Napi::String::New(info.Env(), ggml_backend_dev_description(dev)));
+    device.Set("type", Napi::String::New(info.Env(), ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU ? "cpu" : ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_GPU ? "gpu" : "accel"));
+    device.Set("free", Napi::Number::From(info.Env(), free));
+    device.Set("total", Napi::Number::From(info.Env(), total));
+    devices[i] = device;
+  }
+  result.Set("devices", devices);
+
+  return result;
+}
@@ -26,6 +26,9 @@
 #pragma once
 
 #include "common.h"
+#include "memory.h"
+#include "hash.h"
+#include "threadpool.h"
 
 static Napi::Value getNapiToken(const Napi::CallbackInfo &info, llama_model *model, llama_token token)
 {
@@ -61,14 +64,40 @@ static Napi::Value getNapiControlToken(const Napi::CallbackInfo &info, llama_mod
   return Napi::Number::From(info.Env(), token);
 }
 
+// Identifies the weights of a model: its path, size and metadata, so fine-tunes sharing an architecture differ.
+static llama_node_hash128 llama_node_model_identity(const std::string &path, const llama_model *model)
+{
+  std::string identity = path;
+  identity += '\0' + std::to_string(llama_model_size(model));
+  identity += '\0' + std::to_string(llama_model_n_params(model));
+  identity += '\0' + std::to_string(llama_model_n_embd(model));
+
+  char buf[1024];
+  const int32_t n_meta = llama_model_meta_count(model);
+  for (int32_t i = 0; i < n_meta; ++i)
+  {
+    if (llama_model_meta_key_by_index(model, i, buf, sizeof(buf)) >= 0)
+    {
+      identity += '\0' + std::string(buf);
+    }
+    if (llama_model_meta_val_str_by_index(model, i, buf, sizeof(buf)) >= 0)
+    {
+      identity += '\0' + std::string(buf);
+    }
+  }
+  return llama_node_hash(identity.data(), identity.size());
+}
+
 class LlamaModel : public Napi::ObjectWrap<LlamaModel>
 {
 public:
   llama_model_params params;
-  llama_model *model;
+  llama_model *model = NULL;
 
   std::string modelPath;
+  llama_node_hash128 identity;
   Napi::Reference<Napi::Object> options;
+  ExternalMemory memory;
 
   class LoaderWorker : public Napi::AsyncProgressQueueWorker<float>
   {
@@ -111,6 +140,10 @@ public:
         model->params.progress_callback_user_data = this;
         model->params.progress_callback = progress_callback;
         model->model = llama_model_load_from_file(model->modelPath.c_str(), model->params);
+        if (model->model != NULL)
+        {
+          model->identity = llama_node_model_identity(model->modelPath, model->model);
+        }
       }
       catch (const std::exception &e)
       {
@@ -131,6 +164,7 @@ public:
       }
       else
       {
+        model->memory.update(Env(), llama_node_model_memory_usage(model->model, model->params));
         Callback().Call({});
       }
     }
@@ -184,6 +218,12 @@ public:
 
     auto progress = options.Value().Get("onLoadProgress").As<Napi::Function>();
     auto complete = options.Value().Get("onComplete").As<Napi::Function>();
+    {
+      auto &numa = llama_node_numa_state();
+      std::lock_guard<std::mutex> lock(numa.mutex);
+      numa.model_loaded = true;
+    }
+
     auto worker = new LoaderWorker(complete, progress, this);
     worker->Queue();
   }
@@ -200,6 +240,7 @@ public:
     {
       return;
     }
+    memory.release(Env());
     llama_model_free(model);
     model = NULL;
   }
@@ -359,6 +400,11 @@ public:
     return Napi::Number::From(Env(), llama_model_size(model));
   }
 
+  Napi::Value MemoryUsage(const Napi::CallbackInfo &info)
+  {
+    return getNapiMemoryUsage(Env(), memory.reported);
+  }
+
   Napi::Value MetaLength(const Napi::CallbackInfo &info)
   {
     return Napi::Number::From(Env(), llama_model_meta_count(model));
@@ -413,6 +459,7 @@ public:
             InstanceMethod("vocabularyType", &LlamaModel::VocabularyType),
             InstanceMethod("shouldPrependBosToken", &LlamaModel::ShouldPrependBosToken),
             InstanceMethod("modelSize", &LlamaModel::ModelSize),
+            InstanceMethod("memoryUsage", &LlamaModel::MemoryUsage),
             InstanceMethod("metaLength", &LlamaModel::MetaLength),
             InstanceMethod("metaKey", &LlamaModel::MetaKey),
             InstanceMethod("metaValue", &LlamaModel::MetaValue),
@@ -0,0 +1,126 @@
+//
+//  perf.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "common.h"
+#include "memory.h"
+
+static int64_t llama_node_elapsed_us(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Counters written by worker threads and read from JS. Prompt covers evals of more than
+// one token, decode covers single token evals and batched steps of parallel branches, queue
+// covers the time a job waited for a worker.
+struct llama_node_perf_counters
+{
+  std::atomic<int64_t> prompt_tokens{0};
+  std::atomic<int64_t> prompt_us{0};
+  std::atomic<int64_t> decode_tokens{0};
+  std::atomic<int64_t> decode_us{0};
+  std::atomic<int64_t> sample_count{0};
+  std::atomic<int64_t> sample_us{0};
+  std::atomic<int64_t> queue_count{0};
+  std::atomic<int64_t> queue_us{0};
+
+  void eval(size_t n_tokens, int64_t us)
+  {
+    if (n_tokens > 1)
+    {
+      prompt_tokens += n_tokens;
+      prompt_us += us;
+    }
+    else
+    {
+      decode_tokens += n_tokens;
+      decode_us += us;
+    }
+  }
+
+  void decode(size_t n_tokens, int64_t us)
+  {
+    decode_tokens += n_tokens;
+    decode_us += us;
+  }
+
+  void sample(int64_t us)
+  {
+    ++sample_count;
+    sample_us += us;
+  }
+
+  void queue(int64_t us)
+  {
+    ++queue_count;
+    queue_us += us;
+  }
+
+  void reset()
+  {
+    prompt_tokens = 0;
+    prompt_us = 0;
+    decode_tokens = 0;
+    decode_us = 0;
+    sample_count = 0;
+    sample_us = 0;
+    queue_count = 0;
+    queue_us = 0;
+  }
+};
+
+static Napi::Object getNapiPerf(Napi::Env env, llama_context *ctx, const llama_node_perf_counters &counters)
+{
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("promptTokens", Napi::Number::From(env, counters.prompt_tokens.load()));
+  result.Set("promptMs", Napi::Number::From(env, counters.prompt_us / 1000.0));
+  result.Set("decodeTokens", Napi::Number::From(env, counters.decode_tokens.load()));
+  result.Set("decodeMs", Napi::Number::From(env, counters.decode_us / 1000.0));
+  result.Set("sampleCount", Napi::Number::From(env, counters.sample_count.load()));
+  result.Set("sampleMs", Napi::Number::From(env, counters.sample_us / 1000.0));
+  result.Set("queueCount", Napi::Number::From(env, counters.queue_count.load()));
+  result.Set("queueWaitMs", Napi::Number::From(env, counters.queue_us / 1000.0));
+
+  const size_t kv_size = llama_n_ctx(ctx);
+  const size_t kv_used = llama_node_kv_cells_used(ctx);
+  result.Set("kvUsed", Napi::Number::From(env, kv_used));
+  result.Set("kvSize", Napi::Number::From(env, kv_size));
+  result.Set("kvUtilization", Napi::Number::From(env, kv_size == 0 ? 0.0 : (double)kv_used / kv_size));
+
+  const auto data = llama_perf_context(ctx);
+  Napi::Object engine = Napi::Object::New(env);
+  engine.Set("loadMs", Napi::Number::From(env, data.t_load_ms));
+  engine.Set("promptEvalMs", Napi::Number::From(env, data.t_p_eval_ms));
+  engine.Set("promptEvalTokens", Napi::Number::From(env, data.n_p_eval));
+  engine.Set("evalMs", Napi::Number::From(env, data.t_eval_ms));
+  engine.Set("evalTokens", Napi::Number::From(env, data.n_eval));
+  result.Set("engine", engine);
+
+  return result;
+}
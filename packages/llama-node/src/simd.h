@@ -0,0 +1,133 @@
+//
+//  simd.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <cstddef>
+
+// The addon is built without -mavx2, so the AVX2 kernel is compiled for its own target and picked
+// at runtime.
+#if defined(__x86_64__) || defined(_M_X64)
+#define LLAMA_NODE_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LLAMA_NODE_TARGET_AVX2
+#else
+#define LLAMA_NODE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static inline float llama_node_dot_scalar(const float *a, const float *b, size_t n)
+{
+  size_t i = 0;
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  float sum = (s0 + s1) + (s2 + s3);
+  for (; i < n; ++i)
+  {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+#ifdef LLAMA_NODE_SIMD_X86
+LLAMA_NODE_TARGET_AVX2 static float llama_node_dot_avx2(const float *a, const float *b, size_t n)
+{
+  size_t i = 0;
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (; i + 16 <= n; i += 16)
+  {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  float sum = _mm_cvtss_f32(half);
+  for (; i < n; ++i)
+  {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static bool llama_node_cpu_avx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  const bool fma = (info[2] & (1 << 12)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static const bool llama_node_avx2 = llama_node_cpu_avx2();
+#endif
+
+static inline float llama_node_dot(const float *a, const float *b, size_t n)
+{
+#if defined(LLAMA_NODE_SIMD_X86)
+  return llama_node_avx2 ? llama_node_dot_avx2(a, b, n) : llama_node_dot_scalar(a, b, n);
+#elif defined(__ARM_NEON)
+  size_t i = 0;
+  float32x4_t acc0 = vdupq_n_f32(0);
+  float32x4_t acc1 = vdupq_n_f32(0);
+  for (; i + 8 <= n; i += 8)
+  {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  float32x4_t acc = vaddq_f32(acc0, acc1);
+  float lanes[4];
+  vst1q_f32(lanes, acc);
+  float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < n; ++i)
+  {
+    sum += a[i] * b[i];
+  }
+  return sum;
+#else
+  return llama_node_dot_scalar(a, b, n);
+#endif
+}
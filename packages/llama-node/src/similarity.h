@@ -0,0 +1,114 @@
+//
+//  similarity.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "common.h"
+#include "worker.h"
+#include "simd.h"
+#include "kmeans.h"
+
+// Late interaction score of ColBERT style retrieval: the sum over query tokens of the best
+// dot product with any token of the document. Vectors are rows of `dim` floats.
+static float llama_node_max_sim(const float *query, size_t n_query, const float *document, size_t n_document, size_t dim)
+{
+  float score = 0;
+  for (size_t q = 0; q < n_query; ++q)
+  {
+    float best = n_document > 0 ? -std::numeric_limits<float>::infinity() : 0;
+    for (size_t d = 0; d < n_document; ++d)
+    {
+      best = std::max(best, llama_node_dot(query + q * dim, document + d * dim, dim));
+    }
+    score += best;
+  }
+  return score;
+}
+
+// The query and documents are referenced rather than copied while scoring, so they must not be
+// modified until the promise settles.
+Napi::Value maxSim(const Napi::CallbackInfo &info)
+{
+  Napi::Float32Array query = info[0].As<Napi::Float32Array>();
+  Napi::Array documents = info[1].As<Napi::Array>();
+  const size_t dim = info[2].As<Napi::Number>().Uint32Value();
+
+  if (dim == 0 || query.ElementLength() % dim != 0)
+  {
+    Napi::Error::New(info.Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  const uint32_t n = documents.Length();
+  std::vector<std::pair<const float *, size_t>> inputs(n);
+  auto references = new std::vector<Napi::Reference<Napi::Float32Array>>();
+  references->reserve(n + 1);
+  references->push_back(Napi::Persistent(query));
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    Napi::Float32Array document = documents.Get(i).As<Napi::Float32Array>();
+    if (document.ElementLength() % dim != 0)
+    {
+      delete references;
+      Napi::Error::New(info.Env(), "Invalid comparison of vectors of different lengths").ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+    inputs[i] = std::make_pair(document.Data(), document.ElementLength() / dim);
+    references->push_back(Napi::Persistent(document));
+  }
+
+  const float *_query = query.Data();
+  const size_t n_query = query.ElementLength() / dim;
+
+  auto worker = new _AsyncWorkerWithResult<std::shared_ptr<std::vector<float>>>(
+      info.Env(),
+      [=]()
+      {
+        auto scores = std::make_shared<std::vector<float>>(n);
+        llama_node_parallel_for(n, [&](size_t begin, size_t end)
+                                {
+          for (size_t i = begin; i < end; ++i)
+          {
+            (*scores)[i] = llama_node_max_sim(_query, n_query, inputs[i].first, inputs[i].second, dim);
+          } }, 1);
+        return scores;
+      },
+      [=](Napi::Env env, std::shared_ptr<std::vector<float>> scores) -> napi_value
+      {
+        Napi::Float32Array result = Napi::Float32Array::New(env, scores->size());
+        std::copy(scores->begin(), scores->end(), result.Data());
+        return result;
+      },
+      [=]()
+      {
+        delete references;
+      });
+
+  worker->Queue();
+  return worker->Promise();
+}
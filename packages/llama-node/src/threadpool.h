@@ -0,0 +1,424 @@
+//
+//  threadpool.h
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#pragma once
+
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#include "common.h"
+#include "ggml-cpu.h"
+
+static enum ggml_sched_priority llama_node_sched_priority(const std::string &priority)
+{
+  if (priority == "low")
+  {
+    return GGML_SCHED_PRIO_LOW;
+  }
+  if (priority == "medium")
+  {
+    return GGML_SCHED_PRIO_MEDIUM;
+  }
+  if (priority == "high")
+  {
+    return GGML_SCHED_PRIO_HIGH;
+  }
+  if (priority == "realtime")
+  {
+    return GGML_SCHED_PRIO_REALTIME;
+  }
+  return GGML_SCHED_PRIO_NORMAL;
+}
+
+// Parses a kernel cpu list such as "0-3,8-11".
+static std::vector<int32_t> llama_node_parse_cpulist(const std::string &list)
+{
+  std::vector<int32_t> cpus;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ','))
+  {
+    const auto dash = range.find('-');
+    try
+    {
+      const int32_t first = std::stoi(range.substr(0, dash));
+      const int32_t last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int32_t cpu = first; cpu <= last; ++cpu)
+      {
+        cpus.push_back(cpu);
+      }
+    }
+    catch (const std::exception &)
+    {
+      continue;
+    }
+  }
+  return cpus;
+}
+
+static std::vector<int32_t> llama_node_numa_node_cpus(int32_t node)
+{
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+  std::string list;
+  if (!file || !std::getline(file, list))
+  {
+    return std::vector<int32_t>();
+  }
+  return llama_node_parse_cpulist(list);
+}
+
+static std::vector<int32_t> llama_node_numa_nodes()
+{
+  std::vector<int32_t> nodes;
+#ifndef _WIN32
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir == NULL)
+  {
+    return nodes;
+  }
+  while (struct dirent *entry = readdir(dir))
+  {
+    const std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::all_of(name.begin() + 4, name.end(), ::isdigit))
+    {
+      nodes.push_back(std::stoi(name.substr(4)));
+    }
+  }
+  closedir(dir);
+  std::sort(nodes.begin(), nodes.end());
+#endif
+  return nodes;
+}
+
+struct llama_node_numa
+{
+  std::mutex mutex;
+  bool initialized = false;
+  bool model_loaded = false;
+};
+
+static llama_node_numa &llama_node_numa_state()
+{
+  static llama_node_numa state;
+  return state;
+}
+
+static enum ggml_numa_strategy llama_node_numa_strategy(const std::string &strategy)
+{
+  if (strategy == "distribute")
+  {
+    return GGML_NUMA_STRATEGY_DISTRIBUTE;
+  }
+  if (strategy == "isolate")
+  {
+    return GGML_NUMA_STRATEGY_ISOLATE;
+  }
+  if (strategy == "numactl")
+  {
+    return GGML_NUMA_STRATEGY_NUMACTL;
+  }
+  if (strategy == "mirror")
+  {
+    return GGML_NUMA_STRATEGY_MIRROR;
+  }
+  return GGML_NUMA_STRATEGY_DISABLED;
+}
+
+// ggml only honours the first NUMA initialisation.
+Napi::Value numaInit(const Napi::CallbackInfo &info)
+{
+  auto &numa = llama_node_numa_state();
+  std::lock_guard<std::mutex> lock(numa.mutex);
+  if (numa.model_loaded)
+  {
+    Napi::Error::New(info.Env(), "NUMA must be initialized before any model is loaded").ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+  if (numa.initialized)
+  {
+    return Napi::Boolean::New(info.Env(), false);
+  }
+  llama_numa_init(llama_node_numa_strategy(info[0].As<Napi::String>().Utf8Value()));
+  numa.initialized = true;
+  return Napi::Boolean::New(info.Env(), true);
+}
+
+Napi::Value getNumaNodes(const Napi::CallbackInfo &info)
+{
+  Napi::Array result = Napi::Array::New(info.Env());
+  for (const auto node : llama_node_numa_nodes())
+  {
+    const auto cpus = llama_node_numa_node_cpus(node);
+    Napi::Array list = Napi::Array::New(info.Env(), cpus.size());
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+      list[i] = Napi::Number::From(info.Env(), cpus[i]);
+    }
+    Napi::Object item = Napi::Object::New(info.Env());
+    item.Set("node", Napi::Number::From(info.Env(), node));
+    item.Set("cpus", list);
+    result[result.Length()] = item;
+  }
+  return result;
+}
+
+class LlamaThreadPool : public Napi::ObjectWrap<LlamaThreadPool>
+{
+public:
+  ggml_threadpool_params params;
+  ggml_threadpool *threadpool = NULL;
+  uint32_t attached = 0;
+
+  // A ggml threadpool computes one graph at a time, contexts sharing the pool take turns.
+  std::mutex mutex;
+
+  LlamaThreadPool(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LlamaThreadPool>(info)
+  {
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    std::vector<int32_t> cpus;
+    if (options.Has("numaNode"))
+    {
+      const auto node = options.Get("numaNode").As<Napi::Number>().Int32Value();
+      cpus = llama_node_numa_node_cpus(node);
+      if (cpus.empty())
+      {
+        Napi::Error::New(Env(), "No CPUs on NUMA node " + std::to_string(node)).ThrowAsJavaScriptException();
+        return;
+      }
+    }
+    if (options.Has("cpus"))
+    {
+      Napi::Array list = options.Get("cpus").As<Napi::Array>();
+      for (uint32_t i = 0; i < list.Length(); ++i)
+      {
+        cpus.push_back(list.Get(i).As<Napi::Number>().Int32Value());
+      }
+    }
+
+    int32_t n_threads = cpus.empty() ? std::thread::hardware_concurrency() : cpus.size();
+    if (options.Has("threads"))
+    {
+      const auto threads = options.Get("threads").As<Napi::Number>().Int32Value();
+      n_threads = threads > 0 ? std::min(threads, GGML_MAX_N_THREADS) : n_threads;
+    }
+
+    params = ggml_threadpool_params_default(n_threads);
+
+    for (const auto cpu : cpus)
+    {
+      if (cpu >= 0 && cpu < GGML_MAX_N_THREADS)
+      {
+        params.cpumask[cpu] = true;
+      }
+    }
+
+    if (options.Has("priority"))
+    {
+      params.prio = llama_node_sched_priority(options.Get("priority").As<Napi::String>().Utf8Value());
+    }
+
+    if (options.Has("strictCpu"))
+    {
+      params.strict_cpu = options.Get("strictCpu").As<Napi::Boolean>().Value();
+    }
+
+    if (options.Has("poll"))
+    {
+      params.poll = options.Get("poll").As<Napi::Number>().Uint32Value();
+    }
+
+    threadpool = ggml_threadpool_new(&params);
+    if (threadpool == NULL)
+    {
+      Napi::Error::New(Env(), "Failed to create threadpool").ThrowAsJavaScriptException();
+    }
+  }
+
+  ~LlamaThreadPool()
+  {
+    dispose();
+  }
+
+  void dispose()
+  {
+    if (threadpool == NULL)
+    {
+      return;
+    }
+    ggml_threadpool_free(threadpool);
+    threadpool = NULL;
+  }
+
+  Napi::Value Dispose(const Napi::CallbackInfo &info)
+  {
+    if (attached > 0)
+    {
+      Napi::Error::New(Env(), "Threadpool is attached to a context").ThrowAsJavaScriptException();
+      return Env().Undefined();
+    }
+    if (threadpool != NULL)
+    {
+      dispose();
+    }
+    return Env().Undefined();
+  }
+
+  Napi::Value Threads(const Napi::CallbackInfo &info)
+  {
+    return Napi::Number::From(Env(), params.n_threads);
+  }
+
+  Napi::Value Pause(const Napi::CallbackInfo &info)
+  {
+    ggml_threadpool_pause(threadpool);
+    return Env().Undefined();
+  }
+
+  Napi::Value Resume(const Napi::CallbackInfo &info)
+  {
+    ggml_threadpool_resume(threadpool);
+    return Env().Undefined();
+  }
+
+  static void init(Napi::Object exports)
+  {
+    auto def = DefineClass(
+        exports.Env(),
+        "LlamaThreadPool",
+        {
+            InstanceMethod("threads", &LlamaThreadPool::Threads),
+            InstanceMethod("pause", &LlamaThreadPool::Pause),
+            InstanceMethod("resume", &LlamaThreadPool::Resume),
+            InstanceMethod("dispose", &LlamaThreadPool::Dispose),
+        });
+    exports.Set("LlamaThreadPool", def);
+  }
+};
+
+struct llama_node_threadpool_lock
+{
+  std::unique_lock<std::mutex> pool;
+  std::unique_lock<std::mutex> batch_pool;
+
+  void unlock()
+  {
+    if (pool.owns_lock())
+    {
+      pool.unlock();
+    }
+    if (batch_pool.owns_lock())
+    {
+      batch_pool.unlock();
+    }
+  }
+};
+
+// The pools a context is attached to.
+struct llama_node_threadpools
+{
+  LlamaThreadPool *pool = NULL;
+  LlamaThreadPool *batch_pool = NULL;
+
+  void init(Napi::Object options, llama_context_params &params)
+  {
+    if (options.Has("threadPool"))
+    {
+      pool = Napi::ObjectWrap<LlamaThreadPool>::Unwrap(options.Get("threadPool").As<Napi::Object>());
+      pool->Ref();
+      pool->attached++;
+      params.n_threads = pool->params.n_threads;
+      params.n_threads_batch = pool->params.n_threads;
+    }
+    if (options.Has("batchThreadPool"))
+    {
+      batch_pool = Napi::ObjectWrap<LlamaThreadPool>::Unwrap(options.Get("batchThreadPool").As<Napi::Object>());
+      batch_pool->Ref();
+      batch_pool->attached++;
+      params.n_threads_batch = batch_pool->params.n_threads;
+    }
+  }
+
+  void attach(llama_context *ctx)
+  {
+    if (pool == NULL && batch_pool == NULL)
+    {
+      return;
+    }
+    auto threadpool = pool != NULL ? pool->threadpool : NULL;
+    auto threadpool_batch = batch_pool != NULL ? batch_pool->threadpool : threadpool;
+    llama_attach_threadpool(ctx, threadpool, threadpool_batch);
+  }
+
+  void release()
+  {
+    if (pool != NULL)
+    {
+      pool->attached--;
+      pool->Unref();
+      pool = NULL;
+    }
+    if (batch_pool != NULL)
+    {
+      batch_pool->attached--;
+      batch_pool->Unref();
+      batch_pool = NULL;
+    }
+  }
+
+  // llama_decode picks the pool per ubatch, so a batch of several tokens may end with a single
+  // token ubatch on the decode pool and has to hold both.
+  llama_node_threadpool_lock lock(size_t n_tokens)
+  {
+    llama_node_threadpool_lock lock;
+    if (pool != NULL)
+    {
+      lock.pool = std::unique_lock<std::mutex>(pool->mutex, std::defer_lock);
+    }
+    if (n_tokens > 1 && batch_pool != NULL && batch_pool != pool)
+    {
+      lock.batch_pool = std::unique_lock<std::mutex>(batch_pool->mutex, std::defer_lock);
+    }
+    if (lock.pool.mutex() != NULL && lock.batch_pool.mutex() != NULL)
+    {
+      std::lock(lock.pool, lock.batch_pool);
+    }
+    else if (lock.pool.mutex() != NULL)
+    {
+      lock.pool.lock();
+    }
+    else if (lock.batch_pool.mutex() != NULL)
+    {
+      lock.batch_pool.lock();
+    }
+    return lock;
+  }
+};
@@ -26,14 +26,15 @@
 #pragma once
 
 #include "common.h"
+#include "executor.h"
 
-class _AsyncWorker : public Napi::AsyncWorker
+class _AsyncWorker : public llama_node_task
 {
 public:
   _AsyncWorker(
       Napi::Env env,
       std::function<void()> execute,
-      std::function<void()> finalizer = []() {}) : AsyncWorker(env), execute(execute), finalizer(finalizer), deferred(Napi::Promise::Deferred::New(env))
+      std::function<void()> finalizer = []() {}) : env(env), execute(execute), finalizer(finalizer), deferred(Napi::Promise::Deferred::New(env))
   {
   }
   ~_AsyncWorker()
@@ -46,10 +47,22 @@ public:
     return deferred.Promise();
   }
 
+  // Workers queued with the same owner run one at a time in order.
+  void Queue(const void *owner = NULL, int32_t priority = 0, bool decode = false)
+  {
+    this->owner = owner;
+    this->priority = priority;
+    this->decode = decode;
+    llama_node_executor::shared().submit(env, this);
+  }
+
 private:
+  Napi::Env env;
   std::function<void()> execute;
   std::function<void()> finalizer;
   Napi::Promise::Deferred deferred;
+  std::string error;
+  bool failed = false;
 
   void Execute()
   {
@@ -67,26 +80,40 @@ private:
     }
   }
 
-  void OnOK()
+  void SetError(const std::string &message)
+  {
+    error = message;
+    failed = true;
+  }
+
+  void Complete(Napi::Env env)
   {
-    deferred.Resolve(Env().Undefined());
+    if (failed)
+    {
+      deferred.Reject(Napi::Error::New(env, error).Value());
+    }
+    else
+    {
+      deferred.Resolve(env.Undefined());
+    }
   }
 
-  void OnError(const Napi::Error &err)
+  void Abandon()
   {
-    deferred.Reject(err.Value());
+    execute = nullptr;
+    error.clear();
   }
 };
 
 template <typename R>
-class _AsyncWorkerWithResult : public Napi::AsyncWorker
+class _AsyncWorkerWithResult : public llama_node_task
 {
 public:
   _AsyncWorkerWithResult(
       Napi::Env env,
       std::function<R()> execute,
       std::function<napi_value(Napi::Env env, R result)> resolve,
-      std::function<void()> finalizer = []() {}) : AsyncWorker(env), execute(execute), resolve(resolve), finalizer(finalizer), deferred(Napi::Promise::Deferred::New(env))
+      std::function<void()> finalizer = []() {}) : env(env), execute(execute), resolve(resolve), finalizer(finalizer), deferred(Napi::Promise::Deferred::New(env))
   {
   }
   ~_AsyncWorkerWithResult()
@@ -99,12 +126,24 @@ public:
     return deferred.Promise();
   }
 
+  // Workers queued with the same owner run one at a time in order.
+  void Queue(const void *owner = NULL, int32_t priority = 0, bool decode = false)
+  {
+    this->owner = owner;
+    this->priority = priority;
+    this->decode = decode;
+    llama_node_executor::shared().submit(env, this);
+  }
+
 private:
+  Napi::Env env;
   std::function<R()> execute;
   std::function<napi_value(Napi::Env env, R result)> resolve;
   std::function<void()> finalizer;
   Napi::Promise::Deferred deferred;
   R result;
+  std::string error;
+  bool failed = false;
 
   void Execute()
   {
@@ -122,13 +161,29 @@ private:
     }
   }
 
-  void OnOK()
+  void SetError(const std::string &message)
+  {
+    error = message;
+    failed = true;
+  }
+
+  void Complete(Napi::Env env)
   {
-    deferred.Resolve(resolve(Env(), result));
+    if (failed)
+    {
+      deferred.Reject(Napi::Error::New(env, error).Value());
+    }
+    else
+    {
+      deferred.Resolve(resolve(env, result));
+    }
   }
 
-  void OnError(const Napi::Error &err)
+  void Abandon()
   {
-    deferred.Reject(err.Value());
+    execute = nullptr;
+    resolve = nullptr;
+    result = R();
+    error.clear();
   }
 };
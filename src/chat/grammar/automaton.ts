@@ -0,0 +1,319 @@
+//
+//  automaton.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import { ArraySchema, ObjectSchema, Schema } from '../../context/llama/types/schema';
+
+type Frame =
+  | { kind: 'value'; schema: Schema; }
+  | { kind: 'literal'; text: string; pos: number; }
+  | { kind: 'string'; opened: boolean; escape: boolean; }
+  | { kind: 'number'; }
+  | { kind: 'word'; }
+  | { kind: 'any'; depth: number; string: boolean; escape: boolean; }
+  | { kind: 'array'; items: Schema; stage: 'start' | 'open' | 'after'; }
+  | {
+    kind: 'object';
+    schema: ObjectSchema;
+    stage: 'start' | 'member' | 'comma' | 'key' | 'colon';
+    next: number;
+    comma: boolean;
+    key: string;
+    value?: Schema;
+  };
+
+const isSpace = (c: string) => c === ' ' || c === '\t' || c === '\n' || c === '\r';
+
+// Text of a const as `schemaToJsonGrammarRules` matches it.
+const constText = (value: string | number | boolean | null) => {
+  if (_.isNil(value)) return 'null';
+  if (_.isBoolean(value)) return value ? 'true' : 'false';
+  return `${value}`;
+};
+
+const openValue = (schema: Schema, c: string): Frame => {
+  if ('const' in schema) return { kind: 'literal', text: constText(schema.const), pos: 0 };
+  if ('oneOf' in schema || _.isArray(schema.type)) return { kind: 'any', depth: 0, string: false, escape: false };
+  switch (schema.type) {
+    case 'string': return { kind: 'string', opened: false, escape: false };
+    case 'number':
+    case 'integer': return { kind: 'number' };
+    case 'boolean': return { kind: 'literal', text: c === 't' ? 'true' : 'false', pos: 0 };
+    case 'null': return { kind: 'literal', text: 'null', pos: 0 };
+    case 'array': return { kind: 'array', items: (schema as ArraySchema).items, stage: 'start' };
+    case 'object': return { kind: 'object', schema: schema as ObjectSchema, stage: 'start', next: 0, comma: false, key: '' };
+    default: return { kind: 'any', depth: 0, string: false, escape: false };
+  }
+};
+
+const openingText = (schema: Schema) => {
+  if ('const' in schema) return constText(schema.const);
+  if ('oneOf' in schema || _.isArray(schema.type)) return '';
+  switch (schema.type) {
+    case 'string': return '"';
+    case 'null': return 'null';
+    case 'array': return '[';
+    case 'object': return '{';
+    default: return '';
+  }
+};
+
+// Properties which may come next, up to the first required one, and whether the object may end here.
+const candidates = (frame: Extract<Frame, { kind: 'object'; }>) => {
+  const keys = _.keys(frame.schema.properties);
+  const result: number[] = [];
+  for (let i = frame.next; i < keys.length; i++) {
+    result.push(i);
+    if (_.includes(frame.schema.required, keys[i])) return { keys, indices: result, closable: false };
+  }
+  return { keys, indices: result, closable: true };
+};
+
+// Like the grammar, every property after the first one starts with a comma.
+const allowedKeys = (frame: Extract<Frame, { kind: 'object'; }>) => {
+  const { keys, indices } = candidates(frame);
+  return { keys, indices: _.filter(indices, i => frame.comma ? i > 0 : i === 0) };
+};
+
+/**
+ * Follows the JSON generated for a schema character by character, with the same structure as
+ * `schemaToJsonGrammarRules`, and tells the text the schema forces next: punctuation, property
+ * names, and const or null values. Optional whitespace is never forced.
+ */
+export class JsonSchemaAutomaton {
+
+  /** @internal */
+  _stack: Frame[];
+  /** @internal */
+  _failed = false;
+
+  constructor(schema: Schema) {
+    this._stack = [{ kind: 'value', schema }];
+  }
+
+  /**
+   * The value is complete.
+   */
+  get done() {
+    return _.isEmpty(this._stack);
+  }
+
+  push(text: string) {
+    for (const c of text) this._feed(c);
+  }
+
+  /**
+   * The text which must follow what has been pushed, or an empty string when there is a choice.
+   */
+  forced(): string {
+    const frame = _.last(this._stack);
+    if (this._failed || !frame) return '';
+    switch (frame.kind) {
+      case 'value': return openingText(frame.schema);
+      case 'literal': return frame.text.slice(frame.pos);
+      case 'array': return frame.stage === 'start' ? '[' : '';
+      case 'object':
+        switch (frame.stage) {
+          case 'start': return '{';
+          case 'colon': return ':';
+          case 'member':
+            {
+              const { keys, indices, closable } = candidates(frame);
+              if (closable) return _.isEmpty(indices) ? '}' : '';
+              if (indices.length !== 1) return '';
+              return `${indices[0] > 0 ? ',' : ''}${JSON.stringify(keys[indices[0]])}:`;
+            }
+          case 'comma':
+          case 'key':
+            {
+              const { keys, indices } = allowedKeys(frame);
+              const prefix = frame.stage === 'key' ? `"${frame.key}` : '';
+              const matches = _.filter(indices, i => _.startsWith(JSON.stringify(keys[i]), prefix));
+              if (matches.length !== 1) return '';
+              return `${JSON.stringify(keys[matches[0]]).slice(prefix.length)}:`;
+            }
+        }
+      default: return '';
+    }
+  }
+
+  /**
+   * Pushes the forced text until there is a choice, and returns it.
+   */
+  advance(): string {
+    let result = '';
+    while (true) {
+      const forced = this.forced();
+      if (_.isEmpty(forced)) return result;
+      this.push(forced);
+      result += forced;
+    }
+  }
+
+  /** @internal */
+  private _fail() {
+    this._failed = true;
+  }
+
+  /** @internal */
+  private _feed(c: string) {
+    while (!this._failed) {
+      const frame = _.last(this._stack);
+      if (!frame) {
+        if (!isSpace(c)) this._fail();
+        return;
+      }
+      switch (frame.kind) {
+        case 'value':
+          if (isSpace(c)) return;
+          this._stack[this._stack.length - 1] = openValue(frame.schema, c);
+          continue;
+        case 'literal':
+          if (c !== frame.text[frame.pos]) return this._fail();
+          if (++frame.pos === frame.text.length) this._stack.pop();
+          return;
+        case 'string':
+          if (!frame.opened) {
+            if (c !== '"') return this._fail();
+            frame.opened = true;
+          } else if (frame.escape) {
+            frame.escape = false;
+          } else if (c === '\\') {
+            frame.escape = true;
+          } else if (c === '"') {
+            this._stack.pop();
+          }
+          return;
+        case 'number':
+          if (/[0-9.eE+\-]/.test(c)) return;
+          this._stack.pop();
+          continue;
+        case 'word':
+          if (/[a-z]/.test(c)) return;
+          this._stack.pop();
+          continue;
+        case 'any':
+          if (frame.depth === 0) {
+            if (isSpace(c)) return;
+            if (c === '{' || c === '[') {
+              frame.depth = 1;
+            } else if (c === '"') {
+              this._stack[this._stack.length - 1] = { kind: 'string', opened: true, escape: false };
+            } else if (/[0-9\-]/.test(c)) {
+              this._stack[this._stack.length - 1] = { kind: 'number' };
+            } else if (/[a-z]/.test(c)) {
+              this._stack[this._stack.length - 1] = { kind: 'word' };
+            } else {
+              this._fail();
+            }
+          } else if (frame.string) {
+            if (frame.escape) frame.escape = false;
+            else if (c === '\\') frame.escape = true;
+            else if (c === '"') frame.string = false;
+          } else if (c === '"') {
+            frame.string = true;
+          } else if (c === '{' || c === '[') {
+            frame.depth += 1;
+          } else if ((c === '}' || c === ']') && --frame.depth === 0) {
+            this._stack.pop();
+          }
+          return;
+        case 'array':
+          switch (frame.stage) {
+            case 'start':
+              if (c !== '[') return this._fail();
+              frame.stage = 'open';
+              return;
+            case 'open':
+              if (isSpace(c)) return;
+              if (c === ']') {
+                this._stack.pop();
+                return;
+              }
+              frame.stage = 'after';
+              this._stack.push({ kind: 'value', schema: frame.items });
+              continue;
+            case 'after':
+              if (isSpace(c)) return;
+              if (c === ',') this._stack.push({ kind: 'value', schema: frame.items });
+              else if (c === ']') this._stack.pop();
+              else this._fail();
+              return;
+          }
+        case 'object':
+          switch (frame.stage) {
+            case 'start':
+              if (c !== '{') return this._fail();
+              frame.stage = 'member';
+              return;
+            case 'member':
+              {
+                if (isSpace(c)) return;
+                const { indices, closable } = candidates(frame);
+                if (c === '}' && closable) {
+                  this._stack.pop();
+                } else if (c === ',' && _.some(indices, i => i > 0)) {
+                  frame.stage = 'comma';
+                  frame.comma = true;
+                } else if (c === '"' && _.includes(indices, 0)) {
+                  frame.stage = 'key';
+                  frame.key = '';
+                } else {
+                  this._fail();
+                }
+              }
+              return;
+            case 'comma':
+              if (isSpace(c)) return;
+              if (c !== '"') return this._fail();
+              frame.stage = 'key';
+              frame.key = '';
+              return;
+            case 'key':
+              if (c !== '"' || _.endsWith(frame.key, '\\')) {
+                frame.key += c;
+                return;
+              }
+              {
+                const { keys, indices } = allowedKeys(frame);
+                const found = _.find(indices, i => JSON.stringify(keys[i]) === `"${frame.key}"`);
+                if (_.isNil(found)) return this._fail();
+                frame.next = found + 1;
+                frame.comma = false;
+                frame.value = frame.schema.properties[keys[found]];
+                frame.stage = 'colon';
+              }
+              return;
+            case 'colon':
+              if (isSpace(c)) return;
+              if (c !== ':') return this._fail();
+              frame.stage = 'member';
+              this._stack.push({ kind: 'value', schema: frame.value! });
+              return;
+          }
+      }
+    }
+  }
+}
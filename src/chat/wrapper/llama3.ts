@@ -26,8 +26,9 @@
 import _ from 'lodash';
 import { ChatHistoryItem, ChatModelFunctionCall, ChatSystemMessage, ChatWrapper } from './types';
 import { LlamaContext } from '../../context/llama';
+import type { LlamaModel } from '../../model/llama';
 import { LLMTextValue, SpecialToken } from '../../types';
-import { tokenEndsWith, tokenFind, tokenStartsWith } from '../../utils';
+import { tokenConcat, tokenEndsWith, tokenFind, tokenStartsWith } from '../../utils';
 import { LlamaDevice } from '../../device/llama';
 import { schemaToJsonGrammarRules } from '../grammar/json';
 import { _typeScriptFunctionSignatures } from '../grammar/typescript';
@@ -42,10 +43,28 @@ const endHeaderToken = SpecialToken('<|end_header_id|>');
 
 const roleHeader = (role: string) => [startHeaderToken, role, endHeaderToken, '\n\n'];
 
+type Llama3SpecialTokens = {
+  newline: Uint32Array;
+  beginOfText: Uint32Array;
+  startHeader: Uint32Array;
+  endHeader: Uint32Array;
+  eot: Uint32Array;
+  header: (role: string) => Uint32Array;
+  defaultSystem?: ChatSystemMessage;
+};
+
+// Tokens of the template are the same for every context of a model, they are tokenized once.
+const specialTokens = new WeakMap<LlamaModel, Llama3SpecialTokens>();
+
 export class Llama3ChatWrapper implements ChatWrapper {
 
   parallel: boolean;
 
+  /** @internal */
+  _messages = new WeakMap<ChatHistoryItem, { model: LlamaModel; tokens: Uint32Array; }>();
+  /** @internal */
+  _decoded = new WeakMap<LlamaContext, { model: LlamaModel; tokens: Uint32Array; items: ChatHistoryItem[]; }>();
+
   constructor({ parallel }: { parallel?: boolean; } = {}) {
     this.parallel = parallel ?? true;
   }
@@ -122,43 +141,84 @@ export class Llama3ChatWrapper implements ChatWrapper {
   }
 
   encodeNextContextState(ctx: LlamaContext, role: string, value: LLMTextValue): LLMTextValue {
-    const eot = ctx.model.tokenize(eotToken);
+    const { beginOfText, eot, header } = this._specialTokens(ctx);
     return _.compact([
       _.isEmpty(ctx._tokens) && [
-        beginOfTextToken,
-        roleHeader('system'),
+        beginOfText,
+        header('system'),
         this._defaultSystemMessage(ctx),
-        eotToken,
+        eot,
       ],
-      !_.isEmpty(ctx._tokens) && !tokenEndsWith(ctx.tokens, eot) && eot,
-      roleHeader(role),
+      !_.isEmpty(ctx._tokens) && !tokenEndsWith(ctx._tokens, eot) && eot,
+      header(role),
       value,
-      eotToken,
-      roleHeader('assistant'),
+      eot,
+      header('assistant'),
     ]);
   }
 
+  /** @internal */
+  _specialTokens(ctx: LlamaContext): Llama3SpecialTokens {
+    const model = ctx.model;
+    const cached = specialTokens.get(model);
+    if (cached) return cached;
+    const headers = new Map<string, Uint32Array>();
+    const tokens: Llama3SpecialTokens = {
+      newline: model.tokenize('\n\n'),
+      beginOfText: model.tokenize(beginOfTextToken),
+      startHeader: model.tokenize(startHeaderToken),
+      endHeader: model.tokenize(endHeaderToken),
+      eot: model.tokenize(eotToken),
+      header: (role: string) => {
+        const cached = headers.get(role);
+        if (cached) return cached;
+        const header = model.tokenize(roleHeader(role));
+        headers.set(role, header);
+        return header;
+      },
+    };
+    specialTokens.set(model, tokens);
+    return tokens;
+  }
+
+  /**
+   * Messages are treated as immutable, their tokens are cached by identity.
+   * @internal
+   */
+  _messageTokens(ctx: LlamaContext, item: ChatHistoryItem, encode: () => Uint32Array) {
+    const cached = this._messages.get(item);
+    if (cached?.model === ctx.model) return cached.tokens;
+    const tokens = encode();
+    this._messages.set(item, { model: ctx.model, tokens });
+    return tokens;
+  }
+
   encodeContextState(ctx: LlamaContext, chatHistory: ChatHistoryItem[]) {
 
     const sys = _.first(chatHistory)?.type === 'system' ? _.first(chatHistory) as ChatSystemMessage : undefined;
     const history = sys ? _.drop(chatHistory, 1) : chatHistory;
 
-    const sysMsg = sys?.text ?? this._defaultSystemMessage(ctx);
+    const special = this._specialTokens(ctx);
+    const { eot, header } = special;
+
+    let sysItem = sys;
+    if (!sysItem) {
+      const text = this._defaultSystemMessage(ctx);
+      if (special.defaultSystem?.text !== text) special.defaultSystem = { type: 'system', text };
+      sysItem = special.defaultSystem!;
+    }
 
     const result: {
       item: ChatHistoryItem;
       tokens: Uint32List;
     }[] = [{
-      item: {
-        type: 'system',
-        text: sysMsg,
-      },
-      tokens: ctx.model.tokenize([
-        beginOfTextToken,
-        roleHeader('system'),
-        sysMsg,
-        eotToken,
-      ]),
+      item: sysItem,
+      tokens: this._messageTokens(ctx, sysItem, () => tokenConcat(
+        special.beginOfText,
+        header('system'),
+        ctx.model.tokenize(sysItem!.text),
+        eot,
+      )),
     }];
 
     for (const item of history) {
@@ -166,33 +226,33 @@ export class Llama3ChatWrapper implements ChatWrapper {
         case 'user':
           result.push({
             item,
-            tokens: ctx.model.tokenize([
-              roleHeader('user'),
-              item.text,
-              eotToken,
-            ]),
+            tokens: this._messageTokens(ctx, item, () => tokenConcat(
+              header('user'),
+              ctx.model.tokenize(item.text),
+              eot,
+            )),
           });
           break;
         case 'model':
           result.push({
             item,
-            tokens: ctx.model.tokenize(_.flatMap(item.response, response => {
+            tokens: this._messageTokens(ctx, item, () => tokenConcat(..._.flatMap(item.response, response => {
               if (_.isString(response)) {
                 return [
-                  roleHeader('assistant'),
-                  response,
-                  eotToken,
+                  header('assistant'),
+                  ctx.model.tokenize(response),
+                  eot,
                 ];
               }
               return [
-                roleHeader('assistant'),
-                `${functionCallPrefix}${response.name}(${JSON.stringify(response.params)})`,
-                eotToken,
-                roleHeader('function_call_result'),
-                JSON.stringify(response.result),
-                eotToken,
+                header('assistant'),
+                ctx.model.tokenize(`${functionCallPrefix}${response.name}(${JSON.stringify(response.params)})`),
+                eot,
+                header('function_call_result'),
+                ctx.model.tokenize(JSON.stringify(response.result)),
+                eot,
               ];
-            })),
+            }))),
           });
           break;
         default: break;
@@ -201,50 +261,73 @@ export class Llama3ChatWrapper implements ChatWrapper {
 
     return result;
   }
+
+  /**
+   * Decodes the tokens after the last user message decoded before again, the earlier messages are
+   * reused when the tokens still start with the same prefix. The tokens of every decoded message are
+   * kept for `encodeContextState`.
+   */
   decodeChatHistory(ctx: LlamaContext, tokens: Uint32Array): ChatHistoryItem[] {
 
-    const newline = ctx.model.tokenize('\n\n');
-    const beginOfText = ctx.model.tokenize(beginOfTextToken);
-    const startHeaderId = ctx.model.tokenize(startHeaderToken);
-    const endHeaderId = ctx.model.tokenize(endHeaderToken);
-    const eotId = ctx.model.tokenize(eotToken);
+    const { newline, beginOfText, startHeader: startHeaderId, endHeader: endHeaderId, eot: eotId } = this._specialTokens(ctx);
 
     if (!tokenStartsWith(tokens, beginOfText)) return [];
-    tokens = tokens.subarray(beginOfText.length);
+
+    const cached = this._decoded.get(ctx);
+    const reused = cached && cached.model === ctx.model && tokenStartsWith(tokens, cached.tokens) ? cached : undefined;
+    const prefix = reused?.items ?? [];
+
+    const total = tokens;
+    let rest = total.subarray(reused ? reused.tokens.length : beginOfText.length);
+    const position = () => total.length - rest.length;
 
     const result: ChatHistoryItem[] = [];
+    const spans = new Map<ChatHistoryItem, [number, number]>();
+    let boundary: { offset: number; count: number; } | undefined;
 
-    while (tokens.length > 0) {
+    while (rest.length > 0) {
 
-      if (!tokenStartsWith(tokens, startHeaderId)) return result;
-      tokens = tokens.subarray(startHeaderId.length);
+      const start = position();
 
-      const endHeaderIdx = tokenFind(tokens, endHeaderId);
-      if (endHeaderIdx === -1) return result;
+      if (!tokenStartsWith(rest, startHeaderId)) break;
+      rest = rest.subarray(startHeaderId.length);
 
-      const type = tokens.subarray(0, endHeaderIdx);
-      tokens = tokens.subarray(endHeaderIdx + endHeaderId.length);
+      const endHeaderIdx = tokenFind(rest, endHeaderId);
+      if (endHeaderIdx === -1) break;
 
-      while (tokenStartsWith(tokens, newline)) {
-        tokens = tokens.subarray(newline.length);
+      const type = rest.subarray(0, endHeaderIdx);
+      rest = rest.subarray(endHeaderIdx + endHeaderId.length);
+
+      while (tokenStartsWith(rest, newline)) {
+        rest = rest.subarray(newline.length);
       }
 
-      const _end = tokenFind(tokens, eotId);
-      const content = _end === -1 ? tokens : tokens.subarray(0, _end);
-      tokens = _end === -1 ? new Uint32Array : tokens.subarray(_end + eotId.length);
+      const _end = tokenFind(rest, eotId);
+      const content = _end === -1 ? rest : rest.subarray(0, _end);
+      rest = _end === -1 ? new Uint32Array : rest.subarray(_end + eotId.length);
 
       switch (ctx.model.detokenize(type)) {
         case 'system':
-          result.push({
-            type: 'system',
-            text: content,
-          });
+          {
+            const item: ChatHistoryItem = {
+              type: 'system',
+              text: content,
+            };
+            result.push(item);
+            spans.set(item, [start === beginOfText.length ? 0 : start, position()]);
+            if (_end !== -1) boundary = { offset: position(), count: result.length };
+          }
           break;
         case 'user':
-          result.push({
-            type: 'user',
-            text: ctx.model.detokenize(content),
-          });
+          {
+            const item: ChatHistoryItem = {
+              type: 'user',
+              text: ctx.model.detokenize(content),
+            };
+            result.push(item);
+            spans.set(item, [start, position()]);
+            if (_end !== -1) boundary = { offset: position(), count: result.length };
+          }
           break;
         case 'assistant':
           {
@@ -254,14 +337,17 @@ export class Llama3ChatWrapper implements ChatWrapper {
             if (last?.type === 'model') {
               last.response.push(callIdx === -1 ? _content : _content.slice(0, callIdx));
               if (callIdx !== -1) last.response.push(_content.slice(callIdx));
+              spans.get(last)![1] = position();
             } else {
-              result.push({
+              const item: ChatHistoryItem = {
                 type: 'model',
                 response: _.compact([
                   callIdx === -1 ? _content : _content.slice(0, callIdx),
                   callIdx !== -1 && _content.slice(callIdx),
                 ]),
-              });
+              };
+              result.push(item);
+              spans.set(item, [start, position()]);
             }
           }
           break;
@@ -288,19 +374,33 @@ export class Llama3ChatWrapper implements ChatWrapper {
               description: functions[current.name]?.description,
               ...current,
             });
+            spans.get(last)![1] = position();
           }
           break;
         default: break;
       }
     }
 
-    return _.map(result, item => { 
-      if (item.type !== 'model') return item;
-      return {
-        ...item, 
+    const items = _.map(result, item => {
+      const span = spans.get(item);
+      const _item: ChatHistoryItem = item.type !== 'model' ? item : {
+        ...item,
         response: _.filter(item.response, x => !_.isString(x) || !_.startsWith(x, functionCallPrefix)),
-       };
+      };
+      if (span) this._messages.set(_item, { model: ctx.model, tokens: total.slice(span[0], span[1]) });
+      return _item;
     });
+    const history = [...prefix, ...items];
+
+    if (boundary) {
+      this._decoded.set(ctx, {
+        model: ctx.model,
+        tokens: total.slice(0, boundary.offset),
+        items: history.slice(0, prefix.length + boundary.count),
+      });
+    }
+
+    return history;
   }
 
   decodeFunctionCalls(ctx: LlamaContext, tokens: string) {
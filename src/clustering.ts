@@ -0,0 +1,68 @@
+//
+//  clustering.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import * as llamaCpp from './plugins/llamaCpp';
+
+export type KMeansOptions = {
+  /**
+   * Passes over the matrix, or mini-batch steps with `batchSize`. (default to 20, or 100 with `batchSize`)
+   */
+  iterations?: number;
+  /**
+   * Points of each mini-batch step, full passes of Lloyd's algorithm when unset.
+   */
+  batchSize?: number;
+  /**
+   * `kmeans++` seeds from a sample of 64 points a cluster. (default to kmeans++)
+   */
+  init?: 'kmeans++' | 'random';
+  seed?: number;
+};
+
+export type KMeansResult = {
+  /**
+   * `[k x dimensions]` row major centroids.
+   */
+  centroids: Float32Array;
+  /**
+   * Index of the nearest centroid of each vector.
+   */
+  assignments: Uint32Array;
+  /**
+   * Sum of squared distances of the vectors to their centroids.
+   */
+  inertia: number;
+};
+
+export const Clustering = {
+  /**
+   * Clusters the rows of a row major matrix with `dimensions` columns. The matrix is read in place
+   * while clustering and must not be modified until the promise settles.
+   */
+  kmeans: async (matrix: Float32Array, dimensions: number, k: number, options: KMeansOptions = {}): Promise<KMeansResult> => {
+    return await llamaCpp.kmeans(matrix, dimensions, k, _.pickBy(options, v => !_.isNil(v)));
+  },
+};
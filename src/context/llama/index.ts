@@ -30,9 +30,14 @@ import { Worker } from './worker';
 import { Awaitable, _EventIterator } from '@o2ter/utils-js';
 import { LLMContext } from '../base';
 import { LlamaModel } from '../../model/llama';
-import { LLamaChatPromptOptions, LlamaContextOptions } from './types';
+import { LLamaChatPromptOptions, LlamaBranchEvent, LlamaContextOptions, LlamaContextPerf, LlamaSessionState, LlamaStopReason } from './types';
 import { DisposedError, LLMTextValue } from '../../types';
 import { ChatHistoryItem } from '../../chat/wrapper/types';
+import { LlamaMemoryUsage } from '../../model/llama/types';
+import { LlamaAdapter } from '../../model/llama/adapter';
+import { budgetExceeded, notifyBudget } from '../../device/llama/budget';
+import { schemaToJsonGrammarRules } from '../../chat/grammar/json';
+import { JsonSchemaAutomaton } from '../../chat/grammar/automaton';
 import * as llamaCpp from '../../plugins/llamaCpp';
 
 export class LlamaContext extends LLMContext<LlamaModel> {
@@ -51,6 +56,11 @@ export class LlamaContext extends LLMContext<LlamaModel> {
   _chat_history?: ChatHistoryItem[];
   /** @internal */
   _ctx_state: number[] = [];
+  /** @internal */
+  _ctx_restore?: number[];
+
+  /** @internal */
+  _adapters = new Map<LlamaAdapter, number>();
 
   /** @internal */
   constructor(model: LlamaModel, ctx: typeof llamaCpp.LlamaContext, options: LlamaContextOptions) {
@@ -64,6 +74,7 @@ export class LlamaContext extends LLMContext<LlamaModel> {
       if (_.isNil(this._ctx)) return;
       this._ctx.dispose();
       this._ctx = null;
+      notifyBudget();
     });
   }
 
@@ -82,6 +93,14 @@ export class LlamaContext extends LLMContext<LlamaModel> {
    * The max context size of context.
    */
   get maxContextSize(): number {
+    if (_.isNil(this._ctx)) throw new DisposedError();
+    if (_.isNil(this._options.initialContextSize)) return this._ctx.contextSize();
+    return Math.max(this._options.contextSize ?? this.model.contextSize, this._ctx.contextSize());
+  }
+  /**
+   * The tokens the KV cache of context currently holds, which is below `maxContextSize` while an elastic context has not grown to it.
+   */
+  get allocatedContextSize(): number {
     if (_.isNil(this._ctx)) throw new DisposedError();
     return this._ctx.contextSize();
   }
@@ -100,10 +119,125 @@ export class LlamaContext extends LLMContext<LlamaModel> {
     return this._ctx.batchSize();
   }
 
+  /**
+   * Memory held by the KV cache and compute buffers of context.
+   */
+  memoryUsage(): LlamaMemoryUsage {
+    if (_.isNil(this._ctx)) throw new DisposedError();
+    return this._ctx.memoryUsage();
+  }
+
+  /**
+   * Performance counters of context since creation or the last `resetPerf()`.
+   */
+  perf(): LlamaContextPerf {
+    if (_.isNil(this._ctx)) throw new DisposedError();
+    return this._ctx.perf();
+  }
+
+  resetPerf() {
+    if (_.isNil(this._ctx)) throw new DisposedError();
+    this._ctx.resetPerf();
+  }
+
   get tokens() {
     return new Uint32Array(this._tokens);
   }
 
+  /**
+   * The LoRA adapters applied to context and their scales.
+   */
+  get adapters(): ReadonlyMap<LlamaAdapter, number> {
+    return this._adapters;
+  }
+
+  /**
+   * Applies a LoRA adapter, or changes its scale. The cached tokens are evaluated again with the new adapters on the next prompt.
+   */
+  async setAdapter(adapter: LlamaAdapter, scale = 1) {
+    return await this._worker.sync(async () => {
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      if (adapter.model !== this.model) throw Error('Adapter belongs to another model');
+      if (this._adapters.get(adapter) === scale) return;
+      await this._ctx.setAdapter(adapter._native, scale);
+      this._adapters.set(adapter, scale);
+      this._invalidate();
+    });
+  }
+
+  async removeAdapter(adapter: LlamaAdapter) {
+    return await this._worker.sync(async () => {
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      if (!this._adapters.has(adapter)) return;
+      await this._ctx.removeAdapter(adapter._native);
+      this._adapters.delete(adapter);
+      this._invalidate();
+    });
+  }
+
+  async clearAdapters() {
+    return await this._worker.sync(async () => {
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      if (_.isEmpty(this._adapters)) return;
+      await this._ctx.clearAdapters();
+      this._adapters.clear();
+      this._invalidate();
+    });
+  }
+
+  /**
+   * Pages the sequence out of context, into a session file when `path` is given, into memory when
+   * it is undefined, or nowhere when it is null so the tokens are evaluated again on resume.
+   * @internal
+   */
+  async _suspend(path?: string | null): Promise<LlamaSessionState> {
+    return await this._worker.sync(async () => {
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      const state: LlamaSessionState = {
+        tokens: this._tokens,
+        chatHistory: this._chat_history,
+        sequence: this._ctx_state,
+        restore: this._ctx_restore,
+      };
+      if (path === null || _.isEmpty(this._ctx_state)) return state;
+      const data = await this._ctx.saveSequence(new Uint32Array(this._ctx_state), path);
+      return _.isNil(path) ? { ...state, data } : { ...state, path };
+    });
+  }
+
+  /** @internal */
+  async _resume(state: LlamaSessionState) {
+    return await this._worker.sync(async () => {
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      this._tokens = [...state.tokens];
+      this._chat_history = state.chatHistory;
+      this._ctx_state = [];
+      this._ctx_restore = state.restore;
+      const source = state.data ?? state.path;
+      if (_.isNil(source)) {
+        this._removeTokens(0, -1);
+        if (!_.isEmpty(state.sequence)) this._ctx_restore = state.sequence;
+        return;
+      }
+      try {
+        await this._grow(state.sequence.length);
+        await this._ctx.loadSequence(source, state.sequence.length);
+        this._ctx_state = state.sequence;
+      } catch (e) {
+        // the saved state does not fit this context, evaluate the tokens again on the next prompt
+        this._ctx_restore = state.sequence;
+      }
+    });
+  }
+
+  /** @internal */
+  private _invalidate() {
+    if (_.isEmpty(this._ctx_state)) return;
+    this._ctx_restore = this._ctx_state;
+    this._removeTokens(0, -1);
+    this._ctx_state = [];
+  }
+
   get chatWrapper() {
     return this._options.chatOptions?.chatWrapper;
   }
@@ -139,8 +273,13 @@ export class LlamaContext extends LLMContext<LlamaModel> {
   }
 
   /** @internal */
-  private _removeTokens(startPos: number, endPos: number): boolean {
-    return this._ctx.removeTokens(startPos, endPos);
+  private _removeTokens(startPos: number, endPos: number, seq = 0): boolean {
+    return this._ctx.removeTokens(startPos, endPos, seq);
+  }
+
+  /** @internal */
+  private _dropRange(startPos: number, endPos: number): boolean {
+    return this._ctx.dropRange(startPos, endPos);
   }
 
   /** @internal */
@@ -148,29 +287,69 @@ export class LlamaContext extends LLMContext<LlamaModel> {
     return this._ctx.shiftTokens(startPos, endPos, shiftDelta);
   }
 
+  /** @internal */
+  private async _grow(length: number) {
+    if (_.isNil(this._options.initialContextSize)) return;
+    const allocated = this._ctx.contextSize();
+    if (length <= allocated) return;
+    try {
+      await this._ctx.resize(Math.min(Math.max(length, allocated * 2), this.maxContextSize));
+    } catch (e: any) {
+      if (e?.code === 'ERR_BUDGET_EXCEEDED') throw budgetExceeded(e);
+      throw e;
+    }
+  }
+
+  /** @internal */
+  private async _shrink(length: number) {
+    const initialContextSize = this._options.initialContextSize;
+    if (_.isNil(initialContextSize)) return;
+    const allocated = this._ctx.contextSize();
+    if (allocated <= initialContextSize || length * 4 > allocated) return;
+    await this._ctx.resize(Math.max(initialContextSize, length * 2));
+    notifyBudget();
+  }
+
   /** @internal */
   private async _updateTokens(value: Uint32List) {
 
     const tokens = _.isArray(value) ? value : [...value];
+    this._ctx_restore = undefined;
 
     if (tokens.length > this.maxContextSize) {
       throw Error('Invalid context shift operation');
     }
 
+    this._ctx.compact();
+    await this._grow(tokens.length);
+
     let pos = 0;
     for (const diff of await myers(this._ctx_state, tokens)) {
       if (diff.equivalent) pos += diff.equivalent.length;
-      if (diff.remove) {
-        this._removeTokens(pos, pos + diff.remove.length);
+      if (diff.remove && !this._dropRange(pos, pos + diff.remove.length)) {
+        // positions cannot be moved with this model, re-evaluate everything after pos
+        this._removeTokens(pos, -1);
+        this._ctx_state = tokens.slice(0, pos);
+        await this._eval(new Uint32Array(tokens.slice(pos)), pos);
+        this._ctx_state = tokens;
+        await this._shrink(tokens.length);
+        return;
       }
       if (diff.insert) {
         this._shiftTokens(pos, -1, diff.insert.length);
-        await this._eval(new Uint32Array(diff.insert), pos);
+        try {
+          await this._eval(new Uint32Array(diff.insert), pos);
+        } catch (e) {
+          // everything from pos onwards has been dropped from the cache
+          this._ctx_state = tokens.slice(0, pos);
+          throw e;
+        }
         pos += diff.insert.length;
       }
     }
 
     this._ctx_state = tokens;
+    await this._shrink(tokens.length);
   }
 
   /** @internal */
@@ -213,23 +392,39 @@ export class LlamaContext extends LLMContext<LlamaModel> {
   private async _eval(tokens: Uint32List, startPos: number) {
     const _tokens = tokens instanceof Uint32Array ? tokens : new Uint32Array(tokens);
     const batchSize = this.batchSize;
-    for (let i = 0; i < tokens.length; i += batchSize) {
-      await this._ctx.eval(_tokens.subarray(i, i + batchSize), i + startPos, i + batchSize >= _tokens.length);
+    await this._grow(startPos + _tokens.length);
+    try {
+      for (let i = 0; i < tokens.length; i += batchSize) {
+        await this._ctx.eval(_tokens.subarray(i, i + batchSize), i + startPos, i + batchSize >= _tokens.length);
+      }
+    } catch (e) {
+      // roll back the batches already committed so the cache ends at startPos
+      this._removeTokens(startPos, -1);
+      throw e;
     }
   }
 
   /** @internal */
   private async _decodeTokens(value: LLMTextValue) {
 
+    if (!_.isNil(this._ctx_restore)) {
+      await this._updateTokens(this._ctx_restore);
+    }
+
     const tokens = this.model.tokenize(value);
+    const length = this._tokens.length;
     this._tokens.push(...tokens);
 
-    if (this._ctx_state.length + tokens.length > this.maxContextSize) {
-      const _state = await this._contextShiftStrategy();
-      await this._updateTokens(_state);
+    try {
+      if (this._ctx_state.length + tokens.length > this.maxContextSize) {
+        const _state = await this._contextShiftStrategy();
+        await this._updateTokens(_state);
+      }
+      await this._eval(tokens, this._ctx_state.length);
+    } catch (e) {
+      this._tokens.length = length;
+      throw e;
     }
-
-    await this._eval(tokens, this._ctx_state.length);
     this._ctx_state.push(...tokens);
   }
 
@@ -281,6 +476,18 @@ export class LlamaContext extends LLMContext<LlamaModel> {
     }, v => !_.isNil(v)));
   }
 
+  /**
+   * Tokens of text which continues the context, without the space prefix some vocabularies add to
+   * the start of a text.
+   * @internal
+   */
+  private _tokenizeContinuation(text: string) {
+    const prefix = this.model.tokenize('\n');
+    const tokens = this.model.tokenize(`\n${text}`);
+    if (prefix.length < tokens.length && prefix.every((v, i) => v === tokens[i])) return tokens.subarray(prefix.length);
+    return this.model.tokenize(text);
+  }
+
   /** @internal */
   private async _evaluate(
     value: LLMTextValue,
@@ -290,6 +497,12 @@ export class LlamaContext extends LLMContext<LlamaModel> {
 
     const totalTime = clock();
 
+    if (!_.isNil(options.schema)) {
+      if (!_.isNil(options.grammar)) throw Error('schema cannot be combined with grammar');
+      options = { ...options, grammar: schemaToJsonGrammarRules(options.schema).toString() };
+    }
+    const automaton = _.isNil(options.schema) ? undefined : new JsonSchemaAutomaton(options.schema);
+
     const modules = this._evaluate_modules();
     const chatWrapper = this._options.chatOptions?.chatWrapper;
     const sampler = this._sampler(options);
@@ -306,6 +519,14 @@ export class LlamaContext extends LLMContext<LlamaModel> {
 
       if (_.isNil(this._ctx)) throw new DisposedError();
 
+      const _ctx = this._ctx;
+      const onAbort = () => _ctx.abort();
+      if (options.signal?.aborted) return {
+        stopReason: 'abort',
+        totalTime: clock() - totalTime,
+      } as const;
+      options.signal?.addEventListener('abort', onAbort);
+
       try {
 
         while (inputs.length) {
@@ -326,6 +547,30 @@ export class LlamaContext extends LLMContext<LlamaModel> {
               totalTime: clock() - totalTime,
             } as const;
 
+            if (automaton?.done) return {
+              stopReason: 'eogToken',
+              totalTime: clock() - totalTime,
+            } as const;
+
+            const forced = automaton?.forced();
+            if (forced) {
+              const time = clock();
+              const tokens: number[] = [];
+              for (const token of this._tokenizeContinuation(forced)) {
+                if (!sampler.allowsToken(token)) break;
+                sampler.acceptToken(token);
+                tokens.push(token);
+              }
+              if (!_.isEmpty(tokens)) {
+                await this._decodeTokens(new Uint32Array(tokens));
+                automaton?.push(this.model.detokenize(new Uint32Array(tokens)));
+                const _time = (clock() - time) / tokens.length;
+                for (const token of tokens) onToken(token, _time);
+                if (maxTokens > 0) maxTokens = Math.max(0, maxTokens - tokens.length + 1);
+                continue;
+              }
+            }
+
             const time = clock();
             const sample = await this._ctx.sampleToken(_sampler ?? sampler);
 
@@ -342,6 +587,7 @@ export class LlamaContext extends LLMContext<LlamaModel> {
 
             if (!_.isNil(options.grammar)) {
               await this._decodeTokens(sample);
+              automaton?.push(this.model.detokenize(sample));
               onToken(sample, clock() - time);
               continue;
             }
@@ -423,12 +669,148 @@ export class LlamaContext extends LLMContext<LlamaModel> {
           totalTime: clock() - totalTime,
         } as const;
 
+      } catch (e) {
+        if (options.signal?.aborted) return {
+          stopReason: 'abort',
+          totalTime: clock() - totalTime,
+        } as const;
+        throw e;
       } finally {
+        options.signal?.removeEventListener('abort', onAbort);
+        _ctx.resetAbort();
         this._chat_history = undefined;
       }
     });
   }
 
+  /** @internal */
+  private async _evaluateN(
+    value: LLMTextValue,
+    n: number,
+    options: LLamaChatPromptOptions,
+    onEvent: (event: LlamaBranchEvent) => void,
+  ) {
+
+    const totalTime = clock();
+
+    if (!_.isNil(options.schema)) {
+      if (!_.isNil(options.grammar)) throw Error('schema cannot be combined with grammar');
+      options = { ...options, grammar: schemaToJsonGrammarRules(options.schema).toString() };
+    }
+
+    const chatWrapper = this._options.chatOptions?.chatWrapper;
+    const samplers = _.times(n, () => this._sampler(options));
+    const stopTriggers = _.map(
+      options.stopTriggers ?? chatWrapper?.stopGenerationTriggers(this),
+      x => this.model.tokenize(x)
+    );
+    const input = chatWrapper ? chatWrapper.encodeNextContextState(this, 'user', value) : value;
+
+    return await this._worker.sync(async () => {
+
+      if (_.isNil(this._ctx)) throw new DisposedError();
+      if (n > this._ctx.sequences()) throw Error(`promptN needs a context created with at least ${n} sequences`);
+      if (n > this.batchSize) throw Error('promptN needs a batch size of at least n');
+
+      const _ctx = this._ctx;
+      const onAbort = () => _ctx.abort();
+      options.signal?.addEventListener('abort', onAbort);
+
+      const responses = _.times(n, () => [] as number[]);
+      const stopReasons: LlamaStopReason[] = [];
+      const finish = (branch: number, stopReason: LlamaStopReason) => {
+        stopReasons[branch] = stopReason;
+        onEvent({ branch, done: true, response: new Uint32Array(responses[branch]), stopReason });
+      };
+
+      let active = _.range(n);
+      let base = -1;
+
+      try {
+
+        if (!options.signal?.aborted) {
+          if (!_.isNil(options.maxTokens) && options.maxTokens > 0) {
+            await this._grow(this._ctx_state.length + this.model.tokenize(input).length + n * options.maxTokens);
+          }
+          await this._decodeTokens(input);
+          base = this._ctx_state.length;
+          for (let i = 1; i < n; i++) _ctx.copySequence(0, i, 0, base);
+        }
+
+        let maxTokens = options.maxTokens ?? -1;
+        let outputs = _.times(n, () => -1);
+        let cells = base;
+        let full = false;
+
+        while (!_.isEmpty(active) && !options.signal?.aborted && maxTokens--) {
+
+          const time = clock();
+          const samples: number[] = await Promise.all(_.map(active, (branch, i) => _ctx.sampleToken(samplers[branch], outputs[i])));
+          const _time = clock() - time;
+
+          const next: number[] = [];
+          for (const [i, branch] of active.entries()) {
+            const sample = samples[i];
+            if (this.model.isEogToken(sample)) {
+              finish(branch, 'eogToken');
+              continue;
+            }
+            const response = responses[branch];
+            response.push(sample);
+            onEvent({ branch, done: false, response: new Uint32Array(response), token: sample, time: _time });
+            const offset = (trigger: Uint32List) => response.length - trigger.length;
+            if (_.some(stopTriggers, trigger => offset(trigger) >= 0 && trigger.every((v, j) => v === response[j + offset(trigger)]))) {
+              finish(branch, 'stopTrigger');
+              continue;
+            }
+            next.push(branch);
+          }
+
+          active = next;
+          if (_.isEmpty(active) || maxTokens === 0) break;
+          if (cells + active.length > _ctx.contextSize()) {
+            full = true;
+            break;
+          }
+
+          try {
+            await _ctx.evalBatch(
+              new Uint32Array(_.map(active, branch => _.last(responses[branch])!)),
+              new Int32Array(_.map(active, branch => base + responses[branch].length - 1)),
+              new Int32Array(active),
+            );
+          } catch (e) {
+            if (!(e instanceof Error) || e.message !== 'Context is full') throw e;
+            full = true;
+            break;
+          }
+          cells += active.length;
+          outputs = _.range(active.length);
+        }
+
+        for (const branch of active) finish(branch, options.signal?.aborted ? 'abort' : full ? 'contextFull' : 'maxTokens');
+
+      } catch (e) {
+        if (!options.signal?.aborted) throw e;
+        for (const branch of active) finish(branch, 'abort');
+      } finally {
+        options.signal?.removeEventListener('abort', onAbort);
+        _ctx.resetAbort();
+        if (base >= 0) {
+          for (let i = 1; i < n; i++) this._removeTokens(0, -1, i);
+          this._removeTokens(base, -1);
+        }
+        this._chat_history = undefined;
+      }
+
+      return {
+        responses: _.map(responses, x => new Uint32Array(x)),
+        stopReasons,
+        totalTime: clock() - totalTime,
+      };
+    });
+  }
+
   /** @internal */
   private _evaluate_iterator(value: LLMTextValue, options: LLamaChatPromptOptions) {
     type Result = Awaited<ReturnType<LlamaContext['_evaluate']>>;
@@ -454,6 +836,18 @@ export class LlamaContext extends LLMContext<LlamaModel> {
     })();
   }
 
+  /**
+   * Generates `n` alternative responses to the same prompt, which is evaluated once and shared by
+   * every branch. The branches advance together in one batch per step with their own samplers, and
+   * their tokens are yielded as they are sampled. The context keeps the prompt without a response.
+   */
+  promptN(value: LLMTextValue, n: number, options: LLamaChatPromptOptions = {}) {
+    type Result = Awaited<ReturnType<LlamaContext['_evaluateN']>>;
+    return _EventIterator(async (push, resolve) => {
+      resolve(await this._evaluateN(value, n, options, push));
+    })() as AsyncGenerator<LlamaBranchEvent, Result>;
+  }
+
   async evaluate(value: LLMTextValue) {
     const iterator = this._evaluate_iterator(value, { maxTokens: 0 });
     while (true) {
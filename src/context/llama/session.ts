@@ -0,0 +1,206 @@
+//
+//  session.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import fs from 'fs';
+import path from 'path';
+import { Awaitable } from '@o2ter/utils-js';
+import { Worker } from './worker';
+import { LlamaContext } from './index';
+import { LlamaSessionManagerOptions, LlamaSessionState } from './types';
+import { DisposedError } from '../../types';
+import type { LlamaModel } from '../../model/llama';
+
+type LlamaSessionSlot = {
+  ctx: LlamaContext;
+  session?: string;
+  users: number;
+  used: number;
+};
+
+let sessionFileCounter = 0;
+
+/**
+ * Multiplexes many chat sessions onto a few contexts. A session is bound to a context while it
+ * is used, and the least recently used idle session is paged out to memory or a session file
+ * when another session needs its context, so resuming restores the KV cache without evaluating.
+ */
+export class LlamaSessionManager {
+
+  /** @internal */
+  _model: LlamaModel;
+  /** @internal */
+  _options: LlamaSessionManagerOptions;
+
+  /** @internal */
+  _worker = new Worker;
+  /** @internal */
+  _slots?: LlamaSessionSlot[] = [];
+  /** @internal */
+  _sessions = new Map<string, LlamaSessionState>();
+  /** @internal */
+  _waiters: (() => void)[] = [];
+  /** @internal */
+  _memoryBytes = 0;
+
+  /** @internal */
+  constructor(model: LlamaModel, options: LlamaSessionManagerOptions) {
+    this._model = model;
+    this._options = options;
+  }
+
+  async dispose() {
+    await this._worker.sync(async () => {
+      if (_.isNil(this._slots)) return;
+      const slots = this._slots;
+      this._slots = undefined;
+      for (const state of this._sessions.values()) await this._discard(state);
+      this._sessions.clear();
+      await Promise.all(_.map(slots, x => x.ctx.dispose()));
+      for (const wake of this._waiters.splice(0)) wake();
+    });
+  }
+
+  get disposed() {
+    return _.isNil(this._slots);
+  }
+
+  /**
+   * Ids of every session, bound to a context or paged out.
+   */
+  get sessions(): string[] {
+    if (_.isNil(this._slots)) throw new DisposedError();
+    return [..._.compact(_.map(this._slots, x => x.session)), ...this._sessions.keys()];
+  }
+
+  /**
+   * Bytes of KV state of paged out sessions held in memory.
+   */
+  get memoryBytes(): number {
+    return this._memoryBytes;
+  }
+
+  /**
+   * Runs `callback` with a context holding the session, waiting for a context to become idle when all are in use.
+   */
+  async use<R>(id: string, callback: (ctx: LlamaContext) => Awaitable<R>): Promise<R> {
+    const slot = await this._acquire(id);
+    try {
+      return await callback(slot.ctx);
+    } finally {
+      slot.users -= 1;
+      slot.used = Date.now();
+      for (const wake of this._waiters.splice(0)) wake();
+    }
+  }
+
+  /**
+   * Forgets a session and its paged out state.
+   */
+  async delete(id: string) {
+    await this._worker.sync(async () => {
+      if (_.isNil(this._slots)) throw new DisposedError();
+      const state = this._sessions.get(id);
+      if (state) {
+        this._sessions.delete(id);
+        await this._discard(state);
+      }
+      const slot = _.find(this._slots, x => x.session === id);
+      if (slot && slot.users === 0) {
+        slot.session = undefined;
+        await slot.ctx._resume({ tokens: [], sequence: [] });
+      }
+    });
+  }
+
+  /** @internal */
+  private async _acquire(id: string) {
+    while (true) {
+      const { slot, wait } = await this._worker.sync(() => this._bind(id));
+      if (slot) return slot;
+      await wait;
+    }
+  }
+
+  /** @internal */
+  private async _bind(id: string): Promise<{ slot?: LlamaSessionSlot; wait?: Promise<void>; }> {
+
+    if (_.isNil(this._slots)) throw new DisposedError();
+
+    const resident = _.find(this._slots, x => x.session === id);
+    if (resident) {
+      resident.users += 1;
+      return { slot: resident };
+    }
+
+    let slot = _.minBy(_.filter(this._slots, x => x.users === 0), x => x.used);
+    if (!slot && this._slots.length < (this._options.contexts ?? 1)) {
+      const ctx = this._model.createContext({
+        ...this._options.contextOptions,
+        chatOptions: this._options.chatOptions,
+      });
+      slot = { ctx, users: 0, used: 0 };
+      this._slots.push(slot);
+    }
+    if (!slot) {
+      return { wait: new Promise<void>(resolve => this._waiters.push(resolve)) };
+    }
+
+    slot.users += 1;
+    try {
+      if (!_.isNil(slot.session)) {
+        const suspended = await slot.ctx._suspend(this._spillPath());
+        this._memoryBytes += suspended.data?.byteLength ?? 0;
+        this._sessions.set(slot.session, suspended);
+        slot.session = undefined;
+      }
+      const state = this._sessions.get(id);
+      await slot.ctx._resume(state ?? { tokens: [], sequence: [] });
+      if (state) {
+        this._sessions.delete(id);
+        await this._discard(state);
+      }
+      slot.session = id;
+    } catch (e) {
+      slot.users -= 1;
+      throw e;
+    }
+    return { slot };
+  }
+
+  /** @internal */
+  private _spillPath() {
+    const { maxMemoryBytes, directory } = this._options;
+    if (_.isNil(maxMemoryBytes) || this._memoryBytes < maxMemoryBytes) return undefined;
+    if (_.isNil(directory)) return null;
+    return path.join(directory, `${process.pid}-${++sessionFileCounter}.session`);
+  }
+
+  /** @internal */
+  private async _discard(state: LlamaSessionState) {
+    if (state.data) this._memoryBytes -= state.data.byteLength;
+    if (state.path) await fs.promises.rm(state.path, { force: true });
+  }
+}
@@ -24,10 +24,11 @@
 //
 
 import { Awaitable } from '@o2ter/utils-js';
-import { ChatWrapper } from '../../../chat/wrapper/types';
+import { ChatHistoryItem, ChatWrapper } from '../../../chat/wrapper/types';
 import { LLMTextValue } from '../../../types';
 import { Schema } from './schema';
 import type { LlamaContext } from '../index';
+import type { LlamaThreadPool } from '../../../device/llama/threadpool';
 
 export type ChatModelFunctionOptions = {
   description?: string;
@@ -44,6 +45,11 @@ export type LlamaContextOptions = {
    * The context size of context. (default to model's context size)
    */
   contextSize?: number;
+  /**
+   * Starts with a KV cache of this many tokens, which grows up to `contextSize` as positions advance
+   * and shrinks again when the sequence is truncated. (default to allocating `contextSize` upfront)
+   */
+  initialContextSize?: number;
   /**
    * Max number of tokens in a single batch.
    */
@@ -52,10 +58,36 @@ export type LlamaContextOptions = {
    * Memory usage optimization. (default to false)
    */
   flashAttention?: boolean;
+  /**
+   * Fragmentation of the KV cache above which it is defragmented. (default to llama.cpp)
+   */
+  defragThreshold?: number;
   /**
    * Max number of threads. (default to hardware)
    */
   threads?: number;
+  /**
+   * Threads to evaluate with. (default to the device thread pool unless `threads` is set)
+   */
+  threadPool?: LlamaThreadPool;
+  /**
+   * Evaluates on the device thread pool bound to the CPUs of this NUMA node. Only the threads are
+   * pinned: the KV cache and compute buffers are not placed on the node. Cannot be combined with
+   * `threads` or `threadPool`.
+   */
+  numaNode?: number;
+  /**
+   * Threads to evaluate batches of more than one token with. (default to `threadPool`)
+   */
+  batchThreadPool?: LlamaThreadPool;
+  /**
+   * Sequences sharing the KV cache, which `promptN` branches onto. (default to 1)
+   */
+  sequences?: number;
+  /**
+   * Evaluations of contexts with a higher priority run first when the executor is busy. (default to 0)
+   */
+  priority?: number;
 
   chatOptions?: {
     contextShiftStrategy?: (ctx: LlamaContext) => Awaitable<Uint32List>;
@@ -66,6 +98,80 @@ export type LlamaContextOptions = {
   };
 };
 
+export type LlamaStopReason = 'abort' | 'eogToken' | 'stopTrigger' | 'maxTokens' | 'contextFull';
+
+export type LlamaBranchEvent = {
+  branch: number;
+  done: boolean;
+  response: Uint32Array;
+  token?: number;
+  time?: number;
+  stopReason?: LlamaStopReason;
+};
+
+export type LlamaSessionManagerOptions = {
+  /**
+   * Contexts the sessions are multiplexed onto. (default to 1)
+   */
+  contexts?: number;
+  contextOptions?: Omit<LlamaContextOptions, 'chatOptions'>;
+  chatOptions?: LlamaContextOptions['chatOptions'];
+  /**
+   * Max bytes of KV state of idle sessions kept in memory, more is written to `directory`. (default to unlimited)
+   */
+  maxMemoryBytes?: number;
+  /**
+   * Directory of the session files of idle sessions. Without it, sessions over `maxMemoryBytes` are evaluated again on resume.
+   */
+  directory?: string;
+};
+
+/** @internal */
+export type LlamaSessionState = {
+  tokens: number[];
+  chatHistory?: ChatHistoryItem[];
+  sequence: number[];
+  restore?: number[];
+  data?: Uint8Array;
+  path?: string;
+};
+
+export type LlamaContextPerf = {
+  /**
+   * Tokens evaluated in batches of more than one token and the time spent on them.
+   */
+  promptTokens: number;
+  promptMs: number;
+  /**
+   * Tokens evaluated one at a time during generation and the time spent on them.
+   */
+  decodeTokens: number;
+  decodeMs: number;
+  sampleCount: number;
+  sampleMs: number;
+  /**
+   * Native jobs of context and the total time they waited for a worker thread.
+   */
+  queueCount: number;
+  queueWaitMs: number;
+  /**
+   * KV cache cells holding evaluated positions, the number of cells, and their ratio.
+   */
+  kvUsed: number;
+  kvSize: number;
+  kvUtilization: number;
+  /**
+   * Timings reported by llama.cpp.
+   */
+  engine: {
+    loadMs: number;
+    promptEvalMs: number;
+    promptEvalTokens: number;
+    evalMs: number;
+    evalTokens: number;
+  };
+};
+
 export type LlamaSequenceRepeatPenalty = {
   /**
    * Number of recent tokens generated by the model to apply penalties to repetition of.
@@ -93,7 +199,9 @@ export type LlamaSequenceRepeatPenalty = {
 };
 
 export type LLamaChatPromptOptions = {
-
+  /**
+   * Stops the prompt, including an evaluation already running. The context is rolled back to the last evaluated token.
+   */
   signal?: AbortSignal;
 
   maxTokens?: number;
@@ -150,4 +258,9 @@ export type LLamaChatPromptOptions = {
   stopTriggers?: LLMTextValue[];
 
   grammar?: string;
+  /**
+   * Constrains the response to JSON of the schema, with `schemaToJsonGrammarRules`. Cannot be combined with `grammar`.
+   * Text the schema forces, like property names and punctuation, is evaluated without sampling.
+   */
+  schema?: Schema;
 };
\ No newline at end of file
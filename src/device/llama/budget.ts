@@ -0,0 +1,63 @@
+//
+//  budget.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import { BudgetExceededError } from '../../types';
+
+const waiters = new Set<() => void>();
+
+/** @internal */
+export const budgetExceeded = (e: any) => {
+  return e?.code === 'ERR_BUDGET_EXCEEDED' ? new BudgetExceededError(e.message) : e;
+};
+
+/** @internal */
+export const notifyBudget = () => {
+  for (const waiter of waiters) waiter();
+};
+
+/**
+ * Resolves once a context has been released, or after a short interval since contexts
+ * collected without `dispose()` free their budget silently.
+ * @internal
+ */
+export const waitForBudget = (signal?: AbortSignal) => new Promise<void>((res, rej) => {
+  if (signal?.aborted) return rej(signal.reason);
+  const done = () => {
+    waiters.delete(wake);
+    clearTimeout(timer);
+    signal?.removeEventListener('abort', abort);
+  };
+  const wake = () => {
+    done();
+    res();
+  };
+  const abort = () => {
+    done();
+    rej(signal?.reason);
+  };
+  const timer = setTimeout(wake, 250);
+  waiters.add(wake);
+  signal?.addEventListener('abort', abort);
+});
@@ -27,9 +27,19 @@ import _ from 'lodash';
 import path from 'path';
 import { LLMDevice } from '../base';
 import { LlamaModel } from '../../model/llama';
-import { LlamaModelOptions } from '../../model/llama/types';
+import { LlamaEmbeddingCacheOptions, LlamaModelOptions } from '../../model/llama/types';
+import { LlamaEmbeddingCache } from '../../model/llama/cache';
+import { LlamaBudgetOptions, LlamaLogLevel, LlamaLogRecord, LlamaNumaStrategy, LlamaThreadPoolOptions } from './types';
+import { LlamaThreadPool } from './threadpool';
+import { LlamaBM25Index } from '../../search/bm25';
+import { LlamaIVFPQIndex } from '../../search/ivfpq';
+import { LlamaBM25IndexOptions, LlamaIVFPQIndexOptions } from '../../search/types';
 import * as llamaCpp from '../../plugins/llamaCpp';
 
+const logListeners = new Set<(records: LlamaLogRecord[]) => void>();
+let sharedThreadPool: LlamaThreadPool | undefined;
+const numaThreadPools = new Map<number, LlamaThreadPool>();
+
 export class LlamaDevice extends LLMDevice {
 
   static systemInfo() { return llamaCpp.systemInfo(); }
@@ -42,6 +52,100 @@ export class LlamaDevice extends LLMDevice {
   static gpuVramInfo() { return llamaCpp.getGpuVramInfo(); }
   static gpuDeviceInfo() { return llamaCpp.getGpuDeviceInfo(); }
   static gpuType() { return llamaCpp.getGpuType(); }
+  /**
+   * Memory held by all live models and contexts, and the memory of each backend device.
+   */
+  static memoryUsage() { return llamaCpp.getMemoryUsage(); }
+
+  /**
+   * Minimum level of llama.cpp and ggml log records to capture. (default to warn)
+   */
+  static get logLevel(): LlamaLogLevel { return llamaCpp.getLogLevel(); }
+  static set logLevel(level: LlamaLogLevel) { llamaCpp.setLogLevel(level); }
+  /**
+   * Removes and returns up to `max` captured log records, oldest first.
+   */
+  static drainLogs(max?: number) { return llamaCpp.drainLogs(max); }
+  static logStats() { return llamaCpp.getLogStats(); }
+  /**
+   * Receives captured log records in batches as they are emitted. Returns a function to unsubscribe.
+   */
+  static onLog(listener: (records: LlamaLogRecord[]) => void) {
+    if (_.isEmpty(logListeners)) {
+      llamaCpp.subscribeLogs((records) => {
+        for (const listener of logListeners) listener(records);
+      });
+    }
+    logListeners.add(listener);
+    return () => {
+      if (!logListeners.delete(listener)) return;
+      if (_.isEmpty(logListeners)) llamaCpp.unsubscribeLogs();
+    };
+  }
+
+  /**
+   * Sets how threads and model weights are spread over NUMA nodes. Only the first call takes
+   * effect, and it throws once a model has been loaded. Returns whether the strategy was applied.
+   */
+  static numaInit(strategy: LlamaNumaStrategy) { return llamaCpp.numaInit(strategy); }
+  static numaNodes() { return llamaCpp.getNumaNodes(); }
+
+  /**
+   * Statistics of the native executor which runs evaluations off the libuv thread pool.
+   */
+  static executorStats() { return llamaCpp.getExecutorStats(); }
+  static resetExecutorStats() { llamaCpp.resetExecutorStats(); }
+  /**
+   * Grows the native executor to the given number of threads. (default to 4)
+   */
+  static setExecutorThreads(threads: number) { llamaCpp.setExecutorThreads(threads); }
+
+  /**
+   * Limits the KV cache of all contexts and the evaluations running at once. Contexts which
+   * do not fit are refused with `BudgetExceededError`, evaluations over the limit wait in queue.
+   */
+  static setBudget(options: LlamaBudgetOptions) { llamaCpp.setBudget(_.pickBy(options, v => !_.isNil(v))); }
+  static budgetStats() { return llamaCpp.getBudgetStats(); }
+
+  static createThreadPool(options: LlamaThreadPoolOptions = {}) {
+    return new LlamaThreadPool(new llamaCpp.LlamaThreadPool(_.pickBy(options, v => !_.isNil(v))));
+  }
+  /**
+   * The pool used by contexts created without `threads` or `threadPool` options.
+   */
+  static get threadPool() {
+    if (_.isNil(sharedThreadPool)) sharedThreadPool = this.createThreadPool();
+    return sharedThreadPool;
+  }
+  /**
+   * The pool bound to the CPUs of a NUMA node, used by contexts created with `numaNode`.
+   */
+  static numaThreadPool(node: number) {
+    let pool = numaThreadPools.get(node);
+    if (_.isNil(pool)) {
+      pool = this.createThreadPool({ numaNode: node });
+      numaThreadPools.set(node, pool);
+    }
+    return pool;
+  }
+
+  static createBM25Index(options: LlamaBM25IndexOptions = {}) {
+    return new LlamaBM25Index(new llamaCpp.LlamaBM25Index(_.pickBy(options, v => !_.isNil(v))));
+  }
+
+  static createIVFPQIndex({ path: indexPath, ...options }: LlamaIVFPQIndexOptions = {}) {
+    return new LlamaIVFPQIndex(new llamaCpp.LlamaIVFPQIndex(_.pickBy({
+      ...options,
+      path: indexPath ? path.resolve(process.cwd(), indexPath) : undefined,
+    }, v => !_.isNil(v))));
+  }
+
+  static createEmbeddingCache({ path: cachePath, ...options }: LlamaEmbeddingCacheOptions = {}) {
+    return new LlamaEmbeddingCache(new llamaCpp.LlamaEmbeddingCache(_.pickBy({
+      ...options,
+      path: cachePath ? path.resolve(process.cwd(), cachePath) : undefined,
+    }, v => !_.isNil(v))));
+  }
 
   static async loadModel({
     modelPath,
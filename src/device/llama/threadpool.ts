@@ -0,0 +1,71 @@
+//
+//  threadpool.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import { DisposedError } from '../../types';
+import * as llamaCpp from '../../plugins/llamaCpp';
+
+/**
+ * A set of ggml worker threads which contexts attach to instead of creating their own.
+ * Contexts sharing a pool take turns to evaluate, so the cores are never oversubscribed.
+ */
+export class LlamaThreadPool {
+
+  /** @internal */
+  _pool: typeof llamaCpp.LlamaThreadPool;
+
+  /** @internal */
+  constructor(pool: typeof llamaCpp.LlamaThreadPool) {
+    this._pool = pool;
+  }
+
+  /**
+   * Frees the threads. Fails while a context is still attached to the pool.
+   */
+  dispose() {
+    if (_.isNil(this._pool)) return;
+    this._pool.dispose();
+    this._pool = null;
+  }
+
+  get disposed() {
+    return _.isNil(this._pool);
+  }
+
+  get threads(): number {
+    if (_.isNil(this._pool)) throw new DisposedError();
+    return this._pool.threads();
+  }
+
+  pause() {
+    if (_.isNil(this._pool)) throw new DisposedError();
+    this._pool.pause();
+  }
+
+  resume() {
+    if (_.isNil(this._pool)) throw new DisposedError();
+    this._pool.resume();
+  }
+}
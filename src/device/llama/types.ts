@@ -0,0 +1,123 @@
+//
+//  types.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+export enum LlamaLogLevel {
+  none = 0,
+  debug = 1,
+  info = 2,
+  warn = 3,
+  error = 4,
+};
+
+export type LlamaLogRecord = {
+  /**
+   * Milliseconds since epoch when the record was emitted.
+   */
+  timestamp: number;
+  level: LlamaLogLevel;
+  /**
+   * The llama.cpp or ggml component which emitted the record.
+   */
+  source: string;
+  text: string;
+};
+
+export type LlamaNumaStrategy = 'disabled' | 'distribute' | 'isolate' | 'numactl' | 'mirror';
+
+export type LlamaThreadPoolOptions = {
+  /**
+   * Number of threads. (default to the CPUs of `numaNode`, or hardware)
+   */
+  threads?: number;
+  /**
+   * Restricts the threads to the CPUs of a NUMA node.
+   */
+  numaNode?: number;
+  /**
+   * CPU indices the threads are allowed to run on. (default to any)
+   */
+  cpus?: number[];
+  /**
+   * Scheduling priority of the threads. (default to normal)
+   */
+  priority?: 'low' | 'normal' | 'medium' | 'high' | 'realtime';
+  /**
+   * Pins each thread to a single CPU of `cpus` in order. (default to false)
+   */
+  strictCpu?: boolean;
+  /**
+   * Polling level of idle threads, from 0 (no polling) to 100. (default to 50)
+   */
+  poll?: number;
+};
+
+export type LlamaExecutorStats = {
+  threads: number;
+  /**
+   * Tasks waiting for a thread.
+   */
+  queued: number;
+  running: number;
+  /**
+   * Contexts with tasks waiting or running.
+   */
+  queues: number;
+  completed: number;
+  /**
+   * Milliseconds between queuing and starting a task.
+   */
+  averageWaitTime: number;
+  maxWaitTime: number;
+};
+
+export type LlamaBudgetOptions = {
+  /**
+   * Max bytes of KV cache allocated by all contexts. (0 for unlimited)
+   */
+  maxKvBytes?: number;
+  /**
+   * Max number of evaluations running at the same time. (0 for unlimited)
+   */
+  maxConcurrentDecodes?: number;
+};
+
+export type LlamaBudgetStats = {
+  maxKvBytes: number;
+  /**
+   * Bytes of KV cache reserved by live contexts.
+   */
+  kvReserved: number;
+  contexts: number;
+  /**
+   * Contexts refused since start.
+   */
+  rejected: number;
+  maxConcurrentDecodes: number;
+  decoding: number;
+  /**
+   * Tasks waiting in the executor.
+   */
+  queued: number;
+};
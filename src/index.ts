@@ -26,9 +26,11 @@
 export { gbnf } from './chat/grammar/gbnf';
 export { _typeScriptFunctionSignatures } from './chat/grammar/typescript';
 export { schemaToJsonGrammarRules } from './chat/grammar/json';
+export { JsonSchemaAutomaton } from './chat/grammar/automaton';
 export { defineChatSessionFunction } from './context/llama/types';
 
 export * from './similarity';
+export * from './clustering';
 
 export * from './types';
 export * from './chat/wrapper/types';
@@ -37,9 +39,17 @@ export * from './device/base';
 export * from './model/base';
 export * from './context/base';
 
+export * from './device/llama/types';
 export * from './device/llama';
+export * from './device/llama/threadpool';
 export * from './model/llama/types';
 export * from './model/llama';
+export * from './model/llama/adapter';
+export * from './model/llama/cache';
+export * from './search/types';
+export * from './search/bm25';
+export * from './search/ivfpq';
 export * from './context/llama';
+export * from './context/llama/session';
 
 export * from './chat/wrapper';
@@ -0,0 +1,67 @@
+//
+//  adapter.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import { DisposedError } from '../../types';
+import type { LlamaModel } from './index';
+import * as llamaCpp from '../../plugins/llamaCpp';
+
+/**
+ * A LoRA adapter of a base model, which can be applied to any context of that model.
+ */
+export class LlamaAdapter {
+
+  /** @internal */
+  _adapter: typeof llamaCpp.LlamaAdapter;
+
+  readonly model: LlamaModel;
+  readonly path: string;
+
+  /** @internal */
+  constructor(model: LlamaModel, adapter: typeof llamaCpp.LlamaAdapter, path: string) {
+    this.model = model;
+    this.path = path;
+    this._adapter = adapter;
+  }
+
+  /**
+   * Frees the adapter weights. Fails while a context still applies the adapter.
+   */
+  dispose() {
+    if (_.isNil(this._adapter)) return;
+    this._adapter.dispose();
+    this._adapter = null;
+  }
+
+  get disposed() {
+    return _.isNil(this._adapter);
+  }
+
+  /** @internal */
+  get _native() {
+    if (_.isNil(this._adapter)) throw new DisposedError();
+    return this._adapter;
+  }
+}
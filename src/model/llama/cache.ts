@@ -0,0 +1,74 @@
+//
+//  cache.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import { DisposedError } from '../../types';
+import * as llamaCpp from '../../plugins/llamaCpp';
+
+/**
+ * Embeddings keyed by a hash of the model, the tokens, the pooling type and the normalization.
+ * Recently used vectors are kept in memory, and every vector is appended to an optional file.
+ */
+export class LlamaEmbeddingCache {
+
+  /** @internal */
+  _cache: typeof llamaCpp.LlamaEmbeddingCache;
+
+  /** @internal */
+  constructor(cache: typeof llamaCpp.LlamaEmbeddingCache) {
+    this._cache = cache;
+  }
+
+  dispose() {
+    if (_.isNil(this._cache)) return;
+    this._cache.dispose();
+    this._cache = null;
+  }
+
+  get disposed() {
+    return _.isNil(this._cache);
+  }
+
+  stats(): {
+    entries: number;
+    bytes: number;
+    diskEntries: number;
+    diskBytes: number;
+    hits: number;
+    diskHits: number;
+    misses: number;
+  } {
+    if (_.isNil(this._cache)) throw new DisposedError();
+    return this._cache.stats();
+  }
+
+  /**
+   * Drops the in-memory entries. The file is kept.
+   */
+  clear() {
+    if (_.isNil(this._cache)) throw new DisposedError();
+    this._cache.clear();
+  }
+}
@@ -24,14 +24,25 @@
 //
 
 import _ from 'lodash';
+import path from 'path';
 import { LLMModel } from '../base';
 import { LlamaDevice } from '../../device/llama';
-import { SpecialTokenType, DisposedError, LLMTextValue, Vector } from '../../types';
+import { LlamaThreadPool } from '../../device/llama/threadpool';
+import { budgetExceeded, notifyBudget, waitForBudget } from '../../device/llama/budget';
+import { SpecialTokenType, DisposedError, BudgetExceededError, LLMTextValue, Vector } from '../../types';
 import { LlamaContext } from '../../context/llama';
-import { LlamaContextOptions } from '../../context/llama/types';
+import { LlamaContextOptions, LlamaContextPerf, LlamaSessionManagerOptions } from '../../context/llama/types';
+import { LlamaSessionManager } from '../../context/llama/session';
 import { clock } from '../../utils';
 import * as llamaCpp from '../../plugins/llamaCpp';
-import { LlamaPoolingType } from './types';
+import { LlamaEmbedDocumentsOptions, LlamaEmbeddingOptions, LlamaMemoryUsage, LlamaPoolingType, LlamaTokenEmbeddingsOptions } from './types';
+import { LlamaAdapter } from './adapter';
+
+type LlamaEmbeddingVector = Vector | Uint16Array | Int8Array;
+
+const unpackEmbedding = (value: any): { vector: LlamaEmbeddingVector; scale?: number; } => {
+  return _.isNil(value?.data) ? { vector: value } : { vector: value.data, scale: value.scale };
+};
 
 export class LlamaModel extends LLMModel<LlamaDevice> {
 
@@ -143,6 +154,14 @@ export class LlamaModel extends LLMModel<LlamaDevice> {
     return this._model.modelSize();
   }
 
+  /**
+   * Memory held by the model weights.
+   */
+  memoryUsage(): LlamaMemoryUsage {
+    if (_.isNil(this._model)) throw new DisposedError();
+    return this._model.memoryUsage();
+  }
+
   get chatTemplate() {
     return this.meta['tokenizer.chat_template'];
   }
@@ -213,33 +232,278 @@ export class LlamaModel extends LLMModel<LlamaDevice> {
     return [..._detokenize(value)].join('');
   }
 
+  /** @internal */
+  _threadPools({ threads, threadPool, batchThreadPool, numaNode }: {
+    threads?: number;
+    threadPool?: LlamaThreadPool;
+    batchThreadPool?: LlamaThreadPool;
+    numaNode?: number;
+  }) {
+    if (!_.isNil(numaNode) && (!_.isNil(threads) || !_.isNil(threadPool))) throw Error('numaNode cannot be combined with threads or threadPool');
+    const defaultPool = _.isNil(numaNode) ? LlamaDevice.threadPool : LlamaDevice.numaThreadPool(numaNode);
+    return {
+      threadPool: threadPool?._pool ?? (_.isNil(threads) ? defaultPool._pool : undefined),
+      batchThreadPool: batchThreadPool?._pool,
+    };
+  }
+
+  /**
+   * Loads a LoRA adapter of this model. The adapter can be shared by any number of contexts.
+   */
+  async loadAdapter(adapterPath: string) {
+    if (_.isNil(this._model)) throw new DisposedError();
+    const adapter = new llamaCpp.LlamaAdapter(this._model, path.resolve(process.cwd(), adapterPath));
+    await adapter.load();
+    return new LlamaAdapter(this, adapter, adapterPath);
+  }
+
+  /**
+   * Throws `BudgetExceededError` when the KV cache of the context does not fit in the device budget.
+   */
   createContext(options: LlamaContextOptions = {}) {
     const _options = _.pickBy(options, v => !_.isNil(v));
-    const ctx = new llamaCpp.LlamaContext(this._model, _options);
-    return new LlamaContext(this, ctx, _options);
+    try {
+      const ctx = new llamaCpp.LlamaContext(this._model, _.pickBy({
+        ..._options,
+        contextSize: _.isNil(_options.initialContextSize) ? _options.contextSize : Math.min(_options.initialContextSize, _options.contextSize ?? this.contextSize),
+        ...this._threadPools(_options),
+      }, v => !_.isNil(v)));
+      return new LlamaContext(this, ctx, _options);
+    } catch (e) {
+      throw budgetExceeded(e);
+    }
   }
 
-  async embedding(value: LLMTextValue, { batchSize, threads, poolingType, normalize }: {
-    batchSize?: number;
-    threads?: number;
-    poolingType?: LlamaPoolingType;
-    normalize?: number;
-  } = {}) {
+  /**
+   * Creates a manager which multiplexes chat sessions onto `contexts` contexts, paging idle sessions out of them.
+   */
+  createSessionManager(options: LlamaSessionManagerOptions = {}) {
+    return new LlamaSessionManager(this, options);
+  }
+
+  /**
+   * Like `createContext`, but waits for other contexts to be released when the device budget is exhausted.
+   */
+  async requestContext(options: LlamaContextOptions = {}, { signal }: { signal?: AbortSignal; } = {}) {
+    while (true) {
+      try {
+        return this.createContext(options);
+      } catch (e) {
+        if (!(e instanceof BudgetExceededError)) throw e;
+      }
+      await waitForBudget(signal);
+    }
+  }
+
+  /** @internal */
+  _embeddingContext(options: Record<string, any>) {
+    try {
+      return new llamaCpp.LlamaEmbeddingContext(this._model, options);
+    } catch (e) {
+      throw budgetExceeded(e);
+    }
+  }
+
+  async embedding(value: LLMTextValue, {
+    batchSize,
+    threads,
+    threadPool,
+    batchThreadPool,
+    numaNode,
+    priority,
+    poolingType,
+    normalize,
+    dimensions,
+    format,
+    cache,
+  }: LlamaEmbeddingOptions = {}) {
     const time = clock();
     const tokens = this.tokenize(value, { addSpecial: true });
+    const _cache = format === 'float32' || _.isNil(format) ? cache?._cache : undefined;
+    const cacheKey = [this._model, tokens, poolingType ?? LlamaPoolingType.unspecified, normalize ?? -1, dimensions ?? 0] as const;
+    const cached: Vector | undefined = _cache?.get(...cacheKey);
+    if (cached) return { type: 'embedding', vector: cached, scale: undefined, perf: undefined, time: clock() - time } as const;
     const _batchSize = batchSize ?? tokens.length;
-    const ctx = new llamaCpp.LlamaEmbeddingContext(this._model, _.pickBy({
+    const ctx = this._embeddingContext(_.pickBy({
       contextSize: tokens.length,
       batchSize: _batchSize,
       threads,
+      ...this._threadPools({ threads, threadPool, batchThreadPool, numaNode }),
+      priority,
+      poolingType,
+    }, v => !_.isNil(v)));
+    try {
+      for (let i = 0; i < tokens.length; i += _batchSize) {
+        await ctx.eval(tokens.subarray(i, i + _batchSize), i, i + _batchSize >= tokens.length);
+      }
+      const { vector, scale } = unpackEmbedding(ctx.embedding(_.pickBy({ normalize, dimensions, format }, v => !_.isNil(v))));
+      const perf: LlamaContextPerf = ctx.perf();
+      _cache?.set(...cacheKey, vector);
+      return { type: 'embedding', vector, scale, perf, time: clock() - time } as const;
+    } finally {
+      ctx.dispose();
+      notifyBudget();
+    }
+  }
+
+  /**
+   * Embeds every token for late interaction retrieval. The vectors are the rows of a
+   * `[tokens.length x dimensions]` array, to be scored with `Similarity.maxSim`.
+   */
+  async tokenEmbeddings(value: LLMTextValue, {
+    threads,
+    threadPool,
+    batchThreadPool,
+    numaNode,
+    priority,
+    normalize,
+  }: LlamaTokenEmbeddingsOptions = {}) {
+    const time = clock();
+    const tokens = this.tokenize(value, { addSpecial: true });
+    const ctx = this._embeddingContext(_.pickBy({
+      contextSize: tokens.length,
+      batchSize: tokens.length,
+      threads,
+      ...this._threadPools({ threads, threadPool, batchThreadPool, numaNode }),
+      priority,
+      poolingType: LlamaPoolingType.none,
+    }, v => !_.isNil(v)));
+    try {
+      await ctx.eval(tokens, 0, true, true);
+      const vectors: Float32Array = ctx.tokenEmbeddings(tokens.length, _.pickBy({ normalize }, v => !_.isNil(v)));
+      const perf: LlamaContextPerf = ctx.perf();
+      return { type: 'tokenEmbeddings', tokens, vectors, dimensions: this.embeddingSize, perf, time: clock() - time } as const;
+    } finally {
+      ctx.dispose();
+      notifyBudget();
+    }
+  }
+
+  /**
+   * Embeds documents of any length by splitting them into overlapping windows, which are
+   * evaluated as parallel sequences. Yields the chunk vectors of each document in order,
+   * while the next batch is being evaluated.
+   */
+  async *embedDocuments(documents: string | Iterable<LLMTextValue> | AsyncIterable<LLMTextValue>, {
+    windowSize,
+    overlap,
+    sequences = 8,
+    pooled = true,
+    threads,
+    threadPool,
+    batchThreadPool,
+    numaNode,
+    priority,
+    poolingType,
+    normalize,
+    dimensions,
+    format,
+    cache,
+  }: LlamaEmbedDocumentsOptions = {}) {
+
+    if (_.isNil(this._model)) throw new DisposedError();
+
+    const specials = this.tokenize('', { addSpecial: true });
+    const prefix = !_.isNil(this.tokens.bos) && specials[0] === this.tokens.bos ? specials.subarray(0, 1) : specials.subarray(0, 0);
+    const suffix = specials.subarray(prefix.length);
+
+    const _windowSize = Math.min(windowSize ?? 512, this.contextSize);
+    const _contentSize = _windowSize - specials.length;
+    const _overlap = Math.max(0, Math.min(overlap ?? Math.floor(_windowSize / 8), _contentSize - 1));
+    if (_contentSize <= 0) throw Error('Invalid window size');
+
+    type Chunk = { start: number; end: number; tokens: Uint32Array; vector?: LlamaEmbeddingVector; scale?: number; };
+    type Document = { index: number; chunks: Chunk[]; remaining: number; };
+
+    const ctx = this._embeddingContext(_.pickBy({
+      contextSize: _windowSize * sequences,
+      batchSize: _windowSize * sequences,
+      sequences,
+      threads,
+      ...this._threadPools({ threads, threadPool, batchThreadPool, numaNode }),
+      priority,
       poolingType,
     }, v => !_.isNil(v)));
-    for (let i = 0; i < tokens.length; i += _batchSize) {
-      await ctx.eval(tokens.subarray(i, i + _batchSize), i, i + _batchSize >= tokens.length);
+
+    const _float32 = format === 'float32' || _.isNil(format);
+    const _cache = _float32 ? cache?._cache : undefined;
+    const cacheKey = (tokens: Uint32Array) => [this._model, tokens, poolingType ?? LlamaPoolingType.unspecified, normalize ?? -1, dimensions ?? 0] as const;
+    const pending: Document[] = [];
+    let batch: [Document, Chunk][] = [];
+    let running: { batch: typeof batch; promise: Promise<void>; } | undefined;
+
+    const collect = async () => {
+      if (_.isNil(running)) return;
+      const { batch, promise } = running;
+      running = undefined;
+      await promise;
+      const vectors: any[] = ctx.embeddings(batch.length, _.pickBy({ normalize, dimensions, format }, v => !_.isNil(v)));
+      for (const [i, [document, chunk]] of batch.entries()) {
+        Object.assign(chunk, unpackEmbedding(vectors[i]));
+        document.remaining -= 1;
+        _cache?.set(...cacheKey(chunk.tokens), chunk.vector);
+      }
+    };
+    const submit = async () => {
+      await collect();
+      if (_.isEmpty(batch)) return;
+      running = { batch, promise: ctx.evalSequences(_.map(batch, ([, chunk]) => chunk.tokens)) };
+      batch = [];
+    };
+    const result = ({ index, chunks }: Document) => {
+      const vector = pooled && _float32 && !_.isEmpty(chunks) ? new Float32Array(chunks[0].vector!.length) : undefined;
+      if (vector) {
+        const total = _.sumBy(chunks, x => x.end - x.start);
+        for (const chunk of chunks) {
+          const weight = (chunk.end - chunk.start) / total;
+          for (let i = 0; i < vector.length; i++) vector[i] += chunk.vector![i] * weight;
+        }
+        if (normalize === 2) {
+          const norm = Math.sqrt(_.sumBy(vector, v => v * v));
+          if (norm > 0) for (let i = 0; i < vector.length; i++) vector[i] /= norm;
+        }
+      }
+      return {
+        index,
+        chunks: _.map(chunks, ({ start, end, vector, scale }) => ({ start, end, vector: vector!, scale })),
+        vector,
+      };
+    };
+    const ready = function* () {
+      while (!_.isEmpty(pending) && pending[0].remaining === 0) yield result(pending.shift()!);
+    };
+
+    try {
+      let index = 0;
+      for await (const value of _.isString(documents) ? [documents] : documents) {
+
+        const tokens = this.tokenize(value);
+        const document: Document = { index: index++, chunks: [], remaining: 0 };
+        pending.push(document);
+
+        for (let start = 0; start < tokens.length; start += _contentSize - _overlap) {
+          const end = Math.min(start + _contentSize, tokens.length);
+          const chunk: Chunk = { start, end, tokens: new Uint32Array([...prefix, ...tokens.subarray(start, end), ...suffix]) };
+          document.chunks.push(chunk);
+          chunk.vector = _cache?.get(...cacheKey(chunk.tokens));
+          if (_.isNil(chunk.vector)) {
+            document.remaining += 1;
+            batch.push([document, chunk]);
+            if (batch.length === sequences) await submit();
+          }
+          if (end === tokens.length) break;
+        }
+
+        yield* ready();
+      }
+      await submit();
+      await collect();
+      yield* ready();
+    } finally {
+      await running?.promise.catch(() => void 0);
+      ctx.dispose();
+      notifyBudget();
     }
-    const vector = ctx.embedding(_.pickBy({ normalize }, v => !_.isNil(v))) as Vector;
-    ctx.dispose();
-    return { type: 'embedding', vector, time: clock() - time } as const;
   }
 
 }
@@ -23,6 +23,9 @@
 //  THE SOFTWARE.
 //
 
+import type { LlamaThreadPool } from '../../device/llama/threadpool';
+import type { LlamaEmbeddingCache } from './cache';
+
 export type LlamaModelOptions = {
   modelPath: string;
   gpuLayers?: number;
@@ -34,6 +37,101 @@ export type LlamaModelOptions = {
   onLoadProgress?: (progress: number) => void;
 };
 
+export type LlamaMemoryUsage = {
+  /**
+   * Bytes of model weights.
+   */
+  weights: number;
+  /**
+   * Bytes of KV cache allocated for the full context size.
+   */
+  kvAllocated: number;
+  /**
+   * Bytes of KV cache holding evaluated positions.
+   */
+  kvUsed: number;
+  /**
+   * Estimated bytes of compute buffers.
+   */
+  compute: number;
+  /**
+   * Bytes placed in host memory.
+   */
+  host: number;
+  /**
+   * Bytes placed in GPU memory.
+   */
+  device: number;
+  /**
+   * Sum of weights, allocated KV cache and compute buffers.
+   */
+  total: number;
+};
+
+export type LlamaEmbeddingFormat = 'float32' | 'float16' | 'int8';
+
+export type LlamaEmbeddingOptions = {
+  batchSize?: number;
+  threads?: number;
+  threadPool?: LlamaThreadPool;
+  batchThreadPool?: LlamaThreadPool;
+  /**
+   * Evaluates on the device thread pool bound to the CPUs of this NUMA node, see `LlamaContextOptions.numaNode`.
+   */
+  numaNode?: number;
+  priority?: number;
+  poolingType?: LlamaPoolingType;
+  normalize?: number;
+  /**
+   * Keeps the leading dimensions of the vector for Matryoshka models, normalized after truncation. (default to all)
+   */
+  dimensions?: number;
+  /**
+   * `float16` vectors are IEEE half floats in a `Uint16Array`, `int8` vectors come with a `scale`. (default to float32)
+   */
+  format?: LlamaEmbeddingFormat;
+  /**
+   * Returns a cached vector for the same model, tokens and options instead of evaluating.
+   */
+  cache?: LlamaEmbeddingCache;
+};
+
+export type LlamaEmbedDocumentsOptions = Omit<LlamaEmbeddingOptions, 'batchSize'> & {
+  /**
+   * Max tokens of a chunk, including special tokens. (default to 512, or the model's context size if smaller)
+   */
+  windowSize?: number;
+  /**
+   * Tokens shared by consecutive chunks. (default to 1/8 of `windowSize`)
+   */
+  overlap?: number;
+  /**
+   * Chunks evaluated together in one batch. (default to 8)
+   */
+  sequences?: number;
+  /**
+   * Also returns the mean of the chunk vectors weighted by their length, for float32 vectors. (default to true)
+   */
+  pooled?: boolean;
+};
+
+export type LlamaTokenEmbeddingsOptions = Omit<LlamaEmbeddingOptions, 'batchSize' | 'poolingType' | 'dimensions' | 'format' | 'cache'>;
+
+export type LlamaEmbeddingCacheOptions = {
+  /**
+   * Max bytes of vectors kept in memory. (default to 64MB)
+   */
+  maxBytes?: number;
+  /**
+   * File which keeps every vector across restarts.
+   */
+  path?: string;
+  /**
+   * Max bytes of the file, no more vectors are written once it is full. (default to unlimited)
+   */
+  maxDiskBytes?: number;
+};
+
 export enum LlamaPoolingType {
   unspecified = -1,
   none = 0,
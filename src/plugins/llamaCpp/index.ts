@@ -24,11 +24,18 @@
 //
 
 import { pkg } from './pkg';
+import { LlamaMemoryUsage } from '../../model/llama/types';
+import { LlamaBudgetOptions, LlamaBudgetStats, LlamaExecutorStats, LlamaLogLevel, LlamaLogRecord, LlamaNumaStrategy } from '../../device/llama/types';
 
 export const LlamaModel = pkg.LlamaModel;
+export const LlamaAdapter = pkg.LlamaAdapter;
 export const LlamaContext = pkg.LlamaContext;
 export const LlamaContextSampler = pkg.LlamaContextSampler;
 export const LlamaEmbeddingContext = pkg.LlamaEmbeddingContext;
+export const LlamaEmbeddingCache = pkg.LlamaEmbeddingCache;
+export const LlamaBM25Index = pkg.LlamaBM25Index;
+export const LlamaIVFPQIndex = pkg.LlamaIVFPQIndex;
+export const LlamaThreadPool = pkg.LlamaThreadPool;
 
 export const systemInfo = (): string => {
   return pkg.systemInfo();
@@ -46,6 +53,89 @@ export const getGpuType = (): string | undefined => {
   return pkg.getGpuType();
 };
 
+export const getMemoryUsage = (): LlamaMemoryUsage & {
+  devices: {
+    name: string;
+    description: string;
+    type: 'cpu' | 'gpu' | 'accel';
+    free: number;
+    total: number;
+  }[];
+} => {
+  return pkg.getMemoryUsage();
+};
+
+export const setLogLevel = (level: LlamaLogLevel): void => {
+  pkg.setLogLevel(level);
+};
+
+export const getLogLevel = (): LlamaLogLevel => {
+  return pkg.getLogLevel();
+};
+
+export const drainLogs = (max?: number): LlamaLogRecord[] => {
+  return pkg.drainLogs(max);
+};
+
+export const getLogStats = (): { pending: number; dropped: number; } => {
+  return pkg.getLogStats();
+};
+
+export const subscribeLogs = (callback: (records: LlamaLogRecord[]) => void): void => {
+  pkg.subscribeLogs(callback);
+};
+
+export const unsubscribeLogs = (): void => {
+  pkg.unsubscribeLogs();
+};
+
+export const numaInit = (strategy: LlamaNumaStrategy): boolean => {
+  return pkg.numaInit(strategy);
+};
+
+export const getNumaNodes = (): { node: number; cpus: number[]; }[] => {
+  return pkg.getNumaNodes();
+};
+
+export const getExecutorStats = (): LlamaExecutorStats => {
+  return pkg.getExecutorStats();
+};
+
+export const resetExecutorStats = (): void => {
+  pkg.resetExecutorStats();
+};
+
+export const setExecutorThreads = (threads: number): void => {
+  pkg.setExecutorThreads(threads);
+};
+
+export const setBudget = (options: LlamaBudgetOptions): void => {
+  pkg.setBudget(options);
+};
+
+export const getBudgetStats = (): LlamaBudgetStats => {
+  return pkg.getBudgetStats();
+};
+
+export const maxSim = (query: Float32Array, documents: Float32Array[], dimensions: number): Promise<Float32Array> => {
+  return pkg.maxSim(query, documents, dimensions);
+};
+
+export const kmeans = (matrix: Float32Array, dimensions: number, k: number, options: Record<string, any>): Promise<{
+  centroids: Float32Array;
+  assignments: Uint32Array;
+  inertia: number;
+}> => {
+  return pkg.kmeans(matrix, dimensions, k, options);
+};
+
+export const nearDuplicates = (matrix: Float32Array, dimensions: number, options: Record<string, any>): Promise<{
+  pairs: Uint32Array;
+  similarities: Float32Array;
+}> => {
+  return pkg.nearDuplicates(matrix, dimensions, options);
+};
+
 export const getSupportsGpuOffloading = (): boolean => {
   return pkg.getSupportsGpuOffloading();
 };
@@ -0,0 +1,86 @@
+//
+//  bm25.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import { DisposedError } from '../types';
+import { LlamaHybridSearchOptions, LlamaSearchHits } from './types';
+import * as llamaCpp from '../plugins/llamaCpp';
+
+/**
+ * Inverted index scored with BM25. Documents are either strings, split into lowercased words, or
+ * tokens of a model; an index should only hold one kind. Ids are assigned in the order documents
+ * are added, starting from zero.
+ */
+export class LlamaBM25Index {
+
+  /** @internal */
+  _index: typeof llamaCpp.LlamaBM25Index;
+
+  /** @internal */
+  constructor(index: typeof llamaCpp.LlamaBM25Index) {
+    this._index = index;
+  }
+
+  dispose() {
+    if (_.isNil(this._index)) return;
+    this._index.dispose();
+    this._index = null;
+  }
+
+  get disposed() {
+    return _.isNil(this._index);
+  }
+
+  stats(): {
+    documents: number;
+    terms: number;
+    postingBytes: number;
+    vectorBytes: number;
+  } {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return this._index.stats();
+  }
+
+  /**
+   * Adds documents, along with a vector for each one in a hybrid index, and resolves the id of the first one.
+   */
+  async add(documents: (string | Uint32Array)[], vectors?: Float32Array[]): Promise<number> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return await this._index.add(documents, vectors);
+  }
+
+  async search(query: string | Uint32Array, k = 10): Promise<LlamaSearchHits> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return await this._index.search(query, k);
+  }
+
+  /**
+   * Ranks by both BM25 and the dot product with the vectors of the documents, and fuses the rankings.
+   */
+  async hybrid(query: string | Uint32Array, vector: Float32Array, options: LlamaHybridSearchOptions = {}): Promise<LlamaSearchHits> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return await this._index.hybrid(query, vector, _.pickBy(options, v => !_.isNil(v)));
+  }
+}
@@ -0,0 +1,98 @@
+//
+//  ivfpq.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import path from 'path';
+import { DisposedError } from '../types';
+import { LlamaIVFPQSearchOptions, LlamaIVFPQTrainOptions, LlamaVectorHits } from './types';
+import * as llamaCpp from '../plugins/llamaCpp';
+
+/**
+ * Approximate nearest neighbour index of product quantized vectors in inverted lists. Saved lists are
+ * memory mapped, so a search only reads the lists it probes; vectors added since are kept in memory
+ * until `save`. Queries and vectors are concatenated in one `Float32Array`.
+ */
+export class LlamaIVFPQIndex {
+
+  /** @internal */
+  _index: typeof llamaCpp.LlamaIVFPQIndex;
+
+  /** @internal */
+  constructor(index: typeof llamaCpp.LlamaIVFPQIndex) {
+    this._index = index;
+  }
+
+  dispose() {
+    if (_.isNil(this._index)) return;
+    this._index.dispose();
+    this._index = null;
+  }
+
+  get disposed() {
+    return _.isNil(this._index);
+  }
+
+  stats(): {
+    dimensions: number;
+    lists: number;
+    subquantizers: number;
+    trained: boolean;
+    vectors: number;
+    stagedVectors: number;
+    memoryBytes: number;
+  } {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return this._index.stats();
+  }
+
+  /**
+   * Learns the coarse centroids and the codebooks from a sample of at least `max(lists, 256)` vectors.
+   */
+  async train(samples: Float32Array, options: LlamaIVFPQTrainOptions = {}): Promise<void> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    await this._index.train(samples, _.pickBy(options, v => !_.isNil(v)));
+  }
+
+  /**
+   * Adds vectors, with ids counting up from the number of vectors unless given, and resolves the number of vectors.
+   */
+  async add(vectors: Float32Array, ids?: Uint32Array): Promise<number> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return await this._index.add(vectors, ids);
+  }
+
+  async search(queries: Float32Array, options: LlamaIVFPQSearchOptions = {}): Promise<LlamaVectorHits> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    return await this._index.search(queries, _.pickBy(options, v => !_.isNil(v)));
+  }
+
+  /**
+   * Writes the index to a file, by default the one it was opened with, and maps it.
+   */
+  async save(filePath?: string): Promise<void> {
+    if (_.isNil(this._index)) throw new DisposedError();
+    await this._index.save(filePath ? path.resolve(process.cwd(), filePath) : undefined);
+  }
+}
@@ -0,0 +1,110 @@
+//
+//  types.ts
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+export type LlamaBM25IndexOptions = {
+  /**
+   * Term frequency saturation. (default to 1.2)
+   */
+  k1?: number;
+  /**
+   * Document length normalization. (default to 0.75)
+   */
+  b?: number;
+};
+
+export type LlamaSearchHits = {
+  ids: Uint32Array;
+  scores: Float32Array;
+};
+
+export type LlamaHybridSearchOptions = {
+  k?: number;
+  /**
+   * Top documents of each ranking which are fused. (default to 10 * k)
+   */
+  candidates?: number;
+  /**
+   * `rrf` sums reciprocal ranks, `weighted` sums min-max normalized scores. (default to rrf)
+   */
+  fusion?: 'rrf' | 'weighted';
+  /**
+   * Weight of the BM25 scores in weighted fusion, the vector scores get the rest. (default to 0.5)
+   */
+  alpha?: number;
+  /**
+   * Rank offset of reciprocal rank fusion. (default to 60)
+   */
+  rrfK?: number;
+};
+
+export type LlamaIVFPQIndexOptions = {
+  /**
+   * Opens the index saved to this file, or saves a new index there.
+   */
+  path?: string;
+  /**
+   * Dimensions of the vectors, ignored when the file exists.
+   */
+  dimensions?: number;
+  /**
+   * Inverted lists, the number of coarse centroids. (default to 1024)
+   */
+  lists?: number;
+  /**
+   * Subspaces quantized to one byte each, must divide `dimensions`. (default to dimensions / 16)
+   */
+  subquantizers?: number;
+};
+
+export type LlamaIVFPQTrainOptions = {
+  /**
+   * Iterations of k-means. (default to 20, or 100 with `batchSize`)
+   */
+  iterations?: number;
+  /**
+   * Trains with mini-batch k-means on batches of this many samples.
+   */
+  batchSize?: number;
+  seed?: number;
+};
+
+export type LlamaIVFPQSearchOptions = {
+  k?: number;
+  /**
+   * Lists scanned for each query. (default to 8)
+   */
+  nprobe?: number;
+};
+
+export type LlamaVectorHits = {
+  /**
+   * `k` ids for each query, `0xFFFFFFFF` when fewer vectors were found.
+   */
+  ids: Uint32Array;
+  /**
+   * Approximate squared L2 distances, in ascending order for each query.
+   */
+  distances: Float32Array;
+};
@@ -25,6 +25,29 @@
 
 import _ from 'lodash';
 import { Vector } from './types';
+import * as llamaCpp from './plugins/llamaCpp';
+
+export type NearDuplicatesOptions = {
+  /**
+   * Min cosine similarity of a pair. (default to 0.9)
+   */
+  threshold?: number;
+  /**
+   * Hash tables of random hyperplane signatures, a pair is a candidate when it shares any. (default to 64, or more, up to 1024,
+   * when a large input widens the default `bandBits`)
+   */
+  bands?: number;
+  /**
+   * Bits of each signature, at most 64. (default to the most which keep a 99% chance of a pair at the threshold being a candidate,
+   * but no fewer than log2 of the number of vectors so that buckets stay small)
+   */
+  bandBits?: number;
+  /**
+   * Buckets with more vectors are skipped, bounding the work on heavily duplicated data. (default to unlimited)
+   */
+  maxBucketSize?: number;
+  seed?: number;
+};
 
 export const Similarity = {
   distance: (v1: Vector, v2: Vector) => {
@@ -39,4 +62,24 @@ export const Similarity = {
     if (s1 === 0 || s2 === 0) return 0;
     return _.sumBy(_.zip(v1, v2), ([a, b]) => a! * b!) / Math.sqrt(s1 * s2);
   },
+  /**
+   * Late interaction scores of the documents against the query, where each is a row major
+   * array of token vectors with `dimensions` columns. The arrays are read in place and must not be
+   * modified until the promise settles.
+   */
+  maxSim: async (query: Float32Array, documents: Float32Array[], dimensions: number): Promise<Float32Array> => {
+    return await llamaCpp.maxSim(query, documents, dimensions);
+  },
+  /**
+   * Pairs of rows of a row major matrix with `dimensions` columns whose cosine similarity is at least
+   * the threshold, found with locality sensitive hashing and verified exactly. `pairs` holds the row
+   * indices of each pair, the lower first, sorted. The matrix is read in place and must not be
+   * modified until the promise settles.
+   */
+  nearDuplicates: async (matrix: Float32Array, dimensions: number, options: NearDuplicatesOptions = {}): Promise<{
+    pairs: Uint32Array;
+    similarities: Float32Array;
+  }> => {
+    return await llamaCpp.nearDuplicates(matrix, dimensions, _.pickBy(options, v => !_.isNil(v)));
+  },
 };
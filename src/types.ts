@@ -29,6 +29,12 @@ export class DisposedError extends Error {
   }
 }
 
+export class BudgetExceededError extends Error {
+  constructor(message: string) {
+    super(message);
+  }
+}
+
 export class SpecialTokenType {
 
   /** @internal */
@@ -30,6 +30,16 @@ export const clock = () => {
   return seconds + nanoseconds / 1000000000;
 };
 
+export const tokenConcat = (...parts: Uint32List[]) => {
+  const result = new Uint32Array(_.sumBy(parts, x => x.length));
+  let offset = 0;
+  for (const part of parts) {
+    result.set(part, offset);
+    offset += part.length;
+  }
+  return result;
+};
+
 export const tokenFind = (tokens: Uint32List, pattern: Uint32List) => {
   for (let offset = 0; offset < tokens.length; ++offset) {
     if (offset + pattern.length > tokens.length) return -1;
@@ -0,0 +1,257 @@
+//
+//  gguf.mjs
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import fs from 'fs';
+import path from 'path';
+
+const GGUF_MAGIC = 0x46554747;
+const GGUF_VERSION = 3;
+const GGUF_ALIGNMENT = 32;
+
+const GGUF_TYPE = {
+  UINT32: 4,
+  INT32: 5,
+  FLOAT32: 6,
+  STRING: 8,
+  ARRAY: 9,
+};
+
+const GGML_TYPE_F32 = 0;
+
+const TOKEN_TYPE = {
+  NORMAL: 1,
+  UNKNOWN: 2,
+  CONTROL: 3,
+  BYTE: 6,
+};
+
+export const presets = {
+  tiny: { embd: 64, layers: 2, heads: 4, headsKv: 2, ff: 128, context: 512 },
+  small: { embd: 256, layers: 4, heads: 8, headsKv: 4, ff: 768, context: 2048 },
+};
+
+// deterministic PRNG, so the same preset always produces the same file
+const mulberry32 = (seed) => () => {
+  seed |= 0;
+  seed = (seed + 0x6D2B79F5) | 0;
+  let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+  t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+  return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+};
+
+const WORDS = [
+  'the', 'of', 'and', 'to', 'in', 'is', 'that', 'for', 'it', 'as', 'was', 'with', 'be', 'on', 'not',
+  'he', 'this', 'are', 'or', 'his', 'from', 'at', 'which', 'but', 'have', 'an', 'had', 'they', 'you',
+  'were', 'their', 'one', 'all', 'we', 'can', 'her', 'has', 'there', 'been', 'if', 'more', 'when',
+  'will', 'would', 'who', 'so', 'no', 'model', 'token', 'vector', 'context', 'memory', 'search',
+];
+
+const vocabulary = () => {
+  const tokens = ['<unk>', '<s>', '</s>'];
+  const types = [TOKEN_TYPE.UNKNOWN, TOKEN_TYPE.CONTROL, TOKEN_TYPE.CONTROL];
+  const scores = [0, 0, 0];
+  for (let i = 0; i < 256; i++) {
+    tokens.push(`<0x${i.toString(16).toUpperCase().padStart(2, '0')}>`);
+    types.push(TOKEN_TYPE.BYTE);
+    scores.push(0);
+  }
+  const pieces = new Set(['▁']);
+  for (let c = 0x21; c < 0x7f; c++) {
+    pieces.add(String.fromCharCode(c));
+    pieces.add(`▁${String.fromCharCode(c)}`);
+  }
+  for (const word of WORDS) {
+    for (let i = 2; i <= word.length; i++) {
+      pieces.add(word.slice(0, i));
+      pieces.add(`▁${word.slice(0, i)}`);
+    }
+  }
+  // longer pieces get higher scores so the SPM tokenizer prefers merging them
+  for (const piece of pieces) {
+    tokens.push(piece);
+    types.push(TOKEN_TYPE.NORMAL);
+    scores.push(piece.length);
+  }
+  return { tokens, types, scores };
+};
+
+class Writer {
+  constructor(fd) {
+    this.fd = fd;
+    this.offset = 0;
+  }
+  write(buffer) {
+    fs.writeSync(this.fd, buffer);
+    this.offset += buffer.length;
+  }
+  u32(value) {
+    const buffer = Buffer.alloc(4);
+    buffer.writeUInt32LE(value);
+    this.write(buffer);
+  }
+  i32(value) {
+    const buffer = Buffer.alloc(4);
+    buffer.writeInt32LE(value);
+    this.write(buffer);
+  }
+  u64(value) {
+    const buffer = Buffer.alloc(8);
+    buffer.writeBigUInt64LE(BigInt(value));
+    this.write(buffer);
+  }
+  f32(value) {
+    const buffer = Buffer.alloc(4);
+    buffer.writeFloatLE(value);
+    this.write(buffer);
+  }
+  string(value) {
+    const buffer = Buffer.from(value, 'utf8');
+    this.u64(buffer.length);
+    this.write(buffer);
+  }
+  pad() {
+    const padding = (GGUF_ALIGNMENT - (this.offset % GGUF_ALIGNMENT)) % GGUF_ALIGNMENT;
+    if (padding) this.write(Buffer.alloc(padding));
+  }
+  kv(key, type, value) {
+    this.string(key);
+    this.u32(type);
+    switch (type) {
+      case GGUF_TYPE.UINT32: return this.u32(value);
+      case GGUF_TYPE.INT32: return this.i32(value);
+      case GGUF_TYPE.FLOAT32: return this.f32(value);
+      case GGUF_TYPE.STRING: return this.string(value);
+    }
+  }
+  array(key, type, values) {
+    this.string(key);
+    this.u32(GGUF_TYPE.ARRAY);
+    this.u32(type);
+    this.u64(values.length);
+    for (const value of values) {
+      switch (type) {
+        case GGUF_TYPE.INT32: this.i32(value); break;
+        case GGUF_TYPE.FLOAT32: this.f32(value); break;
+        case GGUF_TYPE.STRING: this.string(value); break;
+      }
+    }
+  }
+}
+
+/**
+ * Writes a llama architecture GGUF model with random F32 weights and a small SPM vocabulary.
+ */
+export const generateModel = (file, { embd, layers, heads, headsKv, ff, context }, seed = 42) => {
+
+  const random = mulberry32(seed);
+  const vocab = vocabulary();
+  const n_vocab = vocab.tokens.length;
+  const embdKv = embd / heads * headsKv;
+
+  const tensors = [
+    { name: 'token_embd.weight', dims: [embd, n_vocab] },
+    { name: 'output_norm.weight', dims: [embd], norm: true },
+    { name: 'output.weight', dims: [embd, n_vocab] },
+  ];
+  for (let i = 0; i < layers; i++) {
+    tensors.push(
+      { name: `blk.${i}.attn_norm.weight`, dims: [embd], norm: true },
+      { name: `blk.${i}.attn_q.weight`, dims: [embd, embd] },
+      { name: `blk.${i}.attn_k.weight`, dims: [embd, embdKv] },
+      { name: `blk.${i}.attn_v.weight`, dims: [embd, embdKv] },
+      { name: `blk.${i}.attn_output.weight`, dims: [embd, embd] },
+      { name: `blk.${i}.ffn_norm.weight`, dims: [embd], norm: true },
+      { name: `blk.${i}.ffn_gate.weight`, dims: [embd, ff] },
+      { name: `blk.${i}.ffn_down.weight`, dims: [ff, embd] },
+      { name: `blk.${i}.ffn_up.weight`, dims: [embd, ff] },
+    );
+  }
+
+  let offset = 0;
+  for (const tensor of tensors) {
+    tensor.offset = offset;
+    tensor.size = tensor.dims.reduce((a, b) => a * b, 1) * 4;
+    offset += Math.ceil(tensor.size / GGUF_ALIGNMENT) * GGUF_ALIGNMENT;
+  }
+
+  fs.mkdirSync(path.dirname(file), { recursive: true });
+  const fd = fs.openSync(`${file}.tmp`, 'w');
+  const writer = new Writer(fd);
+
+  try {
+
+    const metadata = [
+      ['general.architecture', GGUF_TYPE.STRING, 'llama'],
+      ['general.name', GGUF_TYPE.STRING, `bench-${embd}x${layers}`],
+      ['general.file_type', GGUF_TYPE.UINT32, 0],
+      ['llama.context_length', GGUF_TYPE.UINT32, context],
+      ['llama.embedding_length', GGUF_TYPE.UINT32, embd],
+      ['llama.block_count', GGUF_TYPE.UINT32, layers],
+      ['llama.feed_forward_length', GGUF_TYPE.UINT32, ff],
+      ['llama.rope.dimension_count', GGUF_TYPE.UINT32, embd / heads],
+      ['llama.attention.head_count', GGUF_TYPE.UINT32, heads],
+      ['llama.attention.head_count_kv', GGUF_TYPE.UINT32, headsKv],
+      ['llama.attention.layer_norm_rms_epsilon', GGUF_TYPE.FLOAT32, 1e-5],
+      ['tokenizer.ggml.model', GGUF_TYPE.STRING, 'llama'],
+      ['tokenizer.ggml.bos_token_id', GGUF_TYPE.UINT32, 1],
+      ['tokenizer.ggml.eos_token_id', GGUF_TYPE.UINT32, 2],
+      ['tokenizer.ggml.unknown_token_id', GGUF_TYPE.UINT32, 0],
+    ];
+
+    writer.u32(GGUF_MAGIC);
+    writer.u32(GGUF_VERSION);
+    writer.u64(tensors.length);
+    writer.u64(metadata.length + 3);
+
+    for (const [key, type, value] of metadata) writer.kv(key, type, value);
+    writer.array('tokenizer.ggml.tokens', GGUF_TYPE.STRING, vocab.tokens);
+    writer.array('tokenizer.ggml.scores', GGUF_TYPE.FLOAT32, vocab.scores);
+    writer.array('tokenizer.ggml.token_type', GGUF_TYPE.INT32, vocab.types);
+
+    for (const tensor of tensors) {
+      writer.string(tensor.name);
+      writer.u32(tensor.dims.length);
+      for (const dim of tensor.dims) writer.u64(dim);
+      writer.u32(GGML_TYPE_F32);
+      writer.u64(tensor.offset);
+    }
+    writer.pad();
+
+    for (const tensor of tensors) {
+      const values = new Float32Array(tensor.size / 4);
+      for (let i = 0; i < values.length; i++) {
+        values[i] = tensor.norm ? 1 : (random() - 0.5) * 0.04;
+      }
+      writer.write(Buffer.from(values.buffer));
+      writer.pad();
+    }
+
+  } finally {
+    fs.closeSync(fd);
+  }
+
+  fs.renameSync(`${file}.tmp`, file);
+  return file;
+};
@@ -0,0 +1,204 @@
+//
+//  index.mjs
+//
+//  The MIT License
+//  Copyright (c) 2021 - 2026 O2ter Limited. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+import _ from 'lodash';
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { createRequire } from 'module';
+import { fileURLToPath } from 'url';
+import { generateModel, presets } from './gguf.mjs';
+
+const require = createRequire(import.meta.url);
+const { LlamaDevice, LlamaPoolingType } = require('../../dist/index.js');
+
+const __dirname = path.dirname(fileURLToPath(import.meta.url));
+
+const args = (() => {
+  const result = {
+    preset: 'small',
+    iterations: 5,
+    threads: undefined,
+    output: undefined,
+    baseline: undefined,
+    threshold: 0.1,
+  };
+  const argv = process.argv.slice(2);
+  for (let i = 0; i < argv.length; i++) {
+    switch (argv[i]) {
+      case '--preset': result.preset = argv[++i]; break;
+      case '--iterations': result.iterations = parseInt(argv[++i]); break;
+      case '--threads': result.threads = parseInt(argv[++i]); break;
+      case '--output': result.output = argv[++i]; break;
+      case '--baseline': result.baseline = argv[++i]; break;
+      case '--threshold': result.threshold = parseFloat(argv[++i]); break;
+      default: throw Error(`Unknown option ${argv[i]}`);
+    }
+  }
+  if (!presets[result.preset]) throw Error(`Unknown preset ${result.preset}`);
+  return result;
+})();
+
+const TEXT = _.times(64, i => `the model has ${i} tokens in the context and the vector search was fast.`).join(' ');
+const GRAMMAR = 'root ::= "{" [a-z ]* "}"';
+
+const stats = (samples) => {
+  const sorted = _.sortBy(samples);
+  return {
+    mean: _.mean(sorted),
+    median: sorted[Math.floor(sorted.length / 2)],
+    min: _.first(sorted),
+    max: _.last(sorted),
+  };
+};
+
+const measure = async (iterations, callback) => {
+  await callback();
+  const samples = [];
+  let units = 0;
+  for (let i = 0; i < iterations; i++) {
+    const start = process.hrtime.bigint();
+    units += (await callback()) ?? 0;
+    samples.push(Number(process.hrtime.bigint() - start) / 1e6);
+  }
+  const ms = stats(samples);
+  return {
+    iterations,
+    ms,
+    unitsPerSecond: units ? units / (_.sum(samples) / 1000) : undefined,
+  };
+};
+
+const main = async () => {
+
+  const preset = presets[args.preset];
+  const modelPath = path.join(__dirname, '../../.cache/bench', `${args.preset}.gguf`);
+  if (!fs.existsSync(modelPath)) generateModel(modelPath, preset);
+
+  const model = await LlamaDevice.loadModel({ modelPath, gpuLayers: 0 });
+  const threads = args.threads;
+
+  const cases = {
+
+    tokenize: () => measure(args.iterations * 10, () => model.tokenize(TEXT).length),
+
+    prefill: async () => {
+      const tokens = model.tokenize(TEXT).subarray(0, Math.min(512, preset.context));
+      return measure(args.iterations, async () => {
+        const ctx = model.createContext({ contextSize: preset.context, batchSize: 512, threads });
+        await ctx.evaluate(tokens);
+        await ctx.dispose();
+        return tokens.length;
+      });
+    },
+
+    generate: async () => {
+      const ctx = model.createContext({ contextSize: preset.context, threads });
+      await ctx.evaluate(model.tokenize(TEXT).subarray(0, 64));
+      const result = await measure(args.iterations, async () => {
+        ctx.resetPerf();
+        for (let i = 0; i < 32; i++) await ctx.evaluate(model.tokenize('the'));
+        return ctx.perf().decodeTokens;
+      });
+      await ctx.dispose();
+      return result;
+    },
+
+    embedding: () => measure(args.iterations, async () => {
+      const { perf } = await model.embedding(TEXT.slice(0, 1024), { poolingType: LlamaPoolingType.mean, threads });
+      return perf.promptTokens + perf.decodeTokens;
+    }),
+
+    grammar: async () => {
+      const ctx = model.createContext({ contextSize: preset.context, threads });
+      const result = await measure(args.iterations, async () => {
+        let tokens = 0;
+        for await (const { done } of ctx.prompt('the', { grammar: GRAMMAR, maxTokens: 32 })) {
+          if (!done) tokens++;
+        }
+        return tokens;
+      });
+      await ctx.dispose();
+      return result;
+    },
+
+    contextShift: async () => {
+      const tokens = model.tokenize(TEXT);
+      const chunk = 48;
+      return measure(args.iterations, async () => {
+        const ctx = model.createContext({ contextSize: 128, threads });
+        for (let i = 0; i + chunk <= Math.min(tokens.length, 8 * chunk); i += chunk) {
+          await ctx.evaluate(tokens.subarray(i, i + chunk));
+        }
+        const { promptTokens, decodeTokens } = ctx.perf();
+        await ctx.dispose();
+        return promptTokens + decodeTokens;
+      });
+    },
+  };
+
+  const results = {};
+  for (const [name, run] of Object.entries(cases)) {
+    results[name] = await run();
+    console.error(`${name}: ${results[name].ms.mean.toFixed(3)} ms`);
+  }
+
+  await model.dispose();
+
+  const report = {
+    timestamp: new Date().toISOString(),
+    node: process.version,
+    platform: `${os.platform()}-${os.arch()}`,
+    cpus: os.cpus().length,
+    system: LlamaDevice.systemInfo(),
+    preset: { name: args.preset, ...preset },
+    results,
+  };
+
+  const json = JSON.stringify(report, null, 2);
+  if (args.output) {
+    fs.writeFileSync(args.output, json);
+  } else {
+    console.log(json);
+  }
+
+  if (args.baseline) {
+    const baseline = JSON.parse(fs.readFileSync(args.baseline, 'utf8'));
+    let regressed = false;
+    for (const [name, result] of Object.entries(results)) {
+      const base = baseline.results?.[name];
+      if (!base) continue;
+      const ratio = result.ms.median / base.ms.median;
+      if (ratio > 1 + args.threshold) regressed = true;
+      console.error(`${name}: ${(ratio * 100 - 100).toFixed(1)}% vs baseline${ratio > 1 + args.threshold ? ' (regression)' : ''}`);
+    }
+    if (regressed) process.exitCode = 1;
+  }
+};
+
+main().catch((e) => {
+  console.error(e);
+  process.exit(1);
+});